@@ -0,0 +1,170 @@
+#include "Buffer.h"
+#include "BufferSlab.h"
+#include "BufferSearch.h"
+
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+const size_t Buffer::kCheapPrepend;
+const size_t Buffer::kInitialSize;
+char Buffer::emptyBuffer_[Buffer::kCheapPrepend];
+
+Buffer::Buffer(const Buffer &rhs)
+    : slab_(rhs.slab_)
+    , buffer_(nullptr)
+    , capacity_(0)
+    , initialSize_(rhs.initialSize_)
+    , readerIndex_(kCheapPrepend)
+    , writerIndex_(kCheapPrepend)
+{
+    if (rhs.readableBytes() > 0)
+    {
+        append(rhs.peek(), rhs.readableBytes());
+    }
+}
+
+Buffer::Buffer(Buffer &&rhs)
+    : slab_(std::move(rhs.slab_))
+    , buffer_(rhs.buffer_)
+    , capacity_(rhs.capacity_)
+    , initialSize_(rhs.initialSize_)
+    , readerIndex_(rhs.readerIndex_)
+    , writerIndex_(rhs.writerIndex_)
+{
+    rhs.buffer_ = nullptr;
+    rhs.capacity_ = 0;
+    rhs.readerIndex_ = rhs.writerIndex_ = kCheapPrepend;
+}
+
+/**
+ * | kCheapPrepend | reader | writer |
+ * | kCheapPrepend |       len         |
+ * 空闲空间（已读走的prependable + writable）不够时才重新分配，否则把数据挪到前面
+ */
+void Buffer::makeSpace(size_t len)
+{
+    const size_t readable = readableBytes();
+    if (buffer_ && writableBytes() + prependableBytes() >= len + kCheapPrepend)
+    {
+        ::memmove(begin() + kCheapPrepend, begin() + readerIndex_, readable);
+    }
+    else
+    {
+        // 至少翻倍增长，第一次分配时按initialSize_分配
+        size_t size = std::max(kCheapPrepend + readable + len,
+                        buffer_ ? capacity_ * 2 : kCheapPrepend + initialSize_);
+        char *buf = slab_ ? slab_->allocate(&size) : static_cast<char*>(::malloc(size));
+        if (readable > 0)
+        {
+            ::memcpy(buf + kCheapPrepend, begin() + readerIndex_, readable);
+        }
+        deallocate();
+        buffer_ = buf;
+        capacity_ = size;
+    }
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = readerIndex_ + readable;
+}
+
+const char* Buffer::findCRLF(const char *start) const
+{
+    return buffersearch::bestFindCRLF()(start, beginWrite());
+}
+
+const char* Buffer::findByte(char c, const char *start) const
+{
+    return buffersearch::findByte(start, beginWrite(), c);
+}
+
+size_t Buffer::shrink(size_t reserve)
+{
+    const size_t oldCapacity = capacity_;
+    const size_t readable = readableBytes();
+    if (readable == 0 && reserve == 0)
+    {
+        deallocate();
+        retrieveAll();
+        return oldCapacity;
+    }
+    if (oldCapacity <= kCheapPrepend + readable + reserve)
+    {
+        return 0;
+    }
+
+    Buffer other(slab_, 0);
+    other.ensureWriteableBytes(readable + reserve);
+    other.append(peek(), readable);
+    other.initialSize_ = initialSize_;
+    swap(other);
+    return oldCapacity > capacity_ ? oldCapacity - capacity_ : 0;
+}
+
+void Buffer::deallocate()
+{
+    if (buffer_)
+    {
+        if (slab_)
+        {
+            slab_->deallocate(buffer_, capacity_);
+        }
+        else
+        {
+            ::free(buffer_);
+        }
+        buffer_ = nullptr;
+        capacity_ = 0;
+    }
+}
+
+/**
+ * 从fd上读取数据  Poller工作在LT模式
+ * Buffer缓冲区是有大小的！ 但是从fd上读数据的时候，却不知道tcp数据最终的大小
+ * 所以在栈上开一块64K的extrabuf，用readv同时读入Buffer的可写区域和extrabuf：
+ * 一次系统调用就能尽量把socket读空，而空闲连接的Buffer也不用常驻一块大内存
+ */
+ssize_t Buffer::readFd(int fd, int* saveErrno)
+{
+    char extrabuf[65536]; // 栈上的内存空间  64K（不需要清零）
+
+    struct iovec vec[2];
+
+    const size_t writable = writableBytes(); // 这是Buffer底层缓冲区剩余的可写空间大小
+    vec[0].iov_base = begin() + writerIndex_;
+    vec[0].iov_len = writable;
+
+    vec[1].iov_base = extrabuf;
+    vec[1].iov_len = sizeof extrabuf;
+
+    // Buffer本身的可写空间已经不小于64K时，就不需要extrabuf了
+    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    else if (static_cast<size_t>(n) <= writable) // Buffer的可写缓冲区已经够存储读出来的数据了
+    {
+        writerIndex_ += n;
+    }
+    else // extrabuf里面也写入了数据
+    {
+        writerIndex_ += writable;
+        append(extrabuf, n - writable);  // writerIndex_开始写 n - writable大小的数据
+    }
+
+    return n;
+}
+
+ssize_t Buffer::writeFd(int fd, int* saveErrno)
+{
+    ssize_t n = ::write(fd, peek(), readableBytes());
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <assert.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+class BufferSlab;
+
+/**
+ * 网络库底层的缓冲区类型定义
+ * +-------------------+------------------+------------------+
+ * | prependable bytes |  readable bytes  |  writable bytes  |
+ * |                   |     (CONTENT)    |                  |
+ * +-------------------+------------------+------------------+
+ * |                   |                  |                  |
+ * 0      <=      readerIndex   <=   writerIndex    <=     size
+ *
+ * prependable区域预留了kCheapPrepend字节，可以在数据前面直接添加长度头而不用挪动数据
+ *
+ * 底层内存在第一次写入时才分配：TcpConnection的Buffer从所属loop的BufferSlab里分配，
+ * 没有slab的Buffer直接用malloc
+ */
+class Buffer
+{
+public:
+    static const size_t kCheapPrepend = 8;      // 头部预留空间
+    static const size_t kInitialSize = 1024;    // 缓冲区初始大小
+
+    explicit Buffer(size_t initialSize = kInitialSize)
+        : buffer_(nullptr)
+        , capacity_(0)
+        , initialSize_(initialSize)
+        , readerIndex_(kCheapPrepend)
+        , writerIndex_(kCheapPrepend)
+    {}
+
+    explicit Buffer(const std::shared_ptr<BufferSlab> &slab, size_t initialSize = kInitialSize)
+        : slab_(slab)
+        , buffer_(nullptr)
+        , capacity_(0)
+        , initialSize_(initialSize)
+        , readerIndex_(kCheapPrepend)
+        , writerIndex_(kCheapPrepend)
+    {}
+
+    ~Buffer() { deallocate(); }
+
+    // 拷贝只拷贝可读数据
+    Buffer(const Buffer &rhs);
+    Buffer(Buffer &&rhs);
+    Buffer& operator=(Buffer rhs) { swap(rhs); return *this; }
+
+    size_t readableBytes() const { return writerIndex_ - readerIndex_; }
+    size_t writableBytes() const { return buffer_ ? capacity_ - writerIndex_ : 0; }
+    size_t prependableBytes() const { return readerIndex_; }
+    // 底层实际占用的内存大小
+    size_t capacity() const { return capacity_; }
+    // 底层内存从哪个slab分配（nullptr表示malloc）。swap会连slab一起交换，
+    // 要把数据换给另一个Buffer而自己仍然用同一个slab时，用它构造对方
+    const std::shared_ptr<BufferSlab>& slab() const { return slab_; }
+
+    // 返回缓冲区中可读数据的起始地址
+    const char* peek() const { return begin() + readerIndex_; }
+
+    void swap(Buffer &rhs)
+    {
+        slab_.swap(rhs.slab_);
+        std::swap(buffer_, rhs.buffer_);
+        std::swap(capacity_, rhs.capacity_);
+        std::swap(initialSize_, rhs.initialSize_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+    }
+
+    // 上层读走了len长度的数据，移动readerIndex_
+    void retrieve(size_t len)
+    {
+        if (len < readableBytes())
+        {
+            readerIndex_ += len;  // 只读取了可读缓冲区数据的一部分
+        }
+        else   // len == readableBytes()
+        {
+            retrieveAll();
+        }
+    }
+
+    void retrieveUntil(const char *end) { retrieve(end - peek()); }
+
+    void retrieveAll()
+    {
+        readerIndex_ = writerIndex_ = kCheapPrepend;
+    }
+
+    // 把onMessage函数上报的Buffer数据，转成string类型的数据返回
+    std::string retrieveAllAsString() { return retrieveAsString(readableBytes()); }
+
+    std::string retrieveAsString(size_t len)
+    {
+        std::string result(peek(), len);
+        retrieve(len); // 上面一句把缓冲区中可读的数据，已经读取出来，这里肯定要对缓冲区进行复位操作
+        return result;
+    }
+
+    // 确保可写区域至少有len字节
+    void ensureWriteableBytes(size_t len)
+    {
+        if (writableBytes() < len)
+        {
+            makeSpace(len); // 扩容函数
+        }
+    }
+
+    // 把[data, data+len]内存上的数据，添加到writable缓冲区当中
+    void append(const char *data, size_t len)
+    {
+        ensureWriteableBytes(len);
+        std::copy(data, data+len, beginWrite());
+        writerIndex_ += len;
+    }
+
+    void append(const std::string &str) { append(str.data(), str.size()); }
+
+    void append(const void *data, size_t len)
+    {
+        append(static_cast<const char*>(data), len);
+    }
+
+    // 在可读数据前面写入len字节（例如长度头），使用的是预留的prependable区域，不需要挪动数据
+    void prepend(const void *data, size_t len)
+    {
+        if (!buffer_)
+        {
+            makeSpace(0);
+        }
+        assert(len <= prependableBytes());
+        readerIndex_ -= len;
+        const char *d = static_cast<const char*>(data);
+        std::copy(d, d+len, begin()+readerIndex_);
+    }
+
+    /**
+     * 在可读数据中查找分隔符，找不到返回nullptr。start必须在[peek(), beginWrite()]之间。
+     * findCRLF按CPU支持的指令集（AVX2/SSE2/标量）在第一次调用时选择实现，findByte/findEOL用memchr
+     */
+    const char* findCRLF() const { return findCRLF(peek()); }
+    const char* findCRLF(const char *start) const;
+    const char* findEOL() const { return findEOL(peek()); }
+    const char* findEOL(const char *start) const { return findByte('\n', start); }
+    const char* findByte(char c) const { return findByte(c, peek()); }
+    const char* findByte(char c, const char *start) const;
+
+    char* beginWrite() { return begin() + writerIndex_; }
+    const char* beginWrite() const { return begin() + writerIndex_; }
+
+    void hasWritten(size_t len) { writerIndex_ += len; }
+
+    // 释放多余的内存，只保留可读数据和reserve字节的可写空间；没有数据且reserve为0时整块释放。
+    // 返回释放的字节数
+    size_t shrink(size_t reserve);
+
+    // 从fd上读取数据
+    ssize_t readFd(int fd, int* saveErrno);
+    // 通过fd发送数据
+    ssize_t writeFd(int fd, int* saveErrno);
+private:
+    // 底层数组的起始地址，还没有分配内存时指向emptyBuffer_（此时readerIndex_ == writerIndex_ == kCheapPrepend）
+    char* begin() { return buffer_ ? buffer_ : emptyBuffer_; }
+    const char* begin() const { return buffer_ ? buffer_ : emptyBuffer_; }
+
+    void makeSpace(size_t len);
+    // 把底层内存还给slab（或者free）
+    void deallocate();
+
+    // 没有分配内存的Buffer共用的占位数组，peek()、beginWrite()总是合法的指针（可读、可写长度都为0）
+    static char emptyBuffer_[kCheapPrepend];
+
+    std::shared_ptr<BufferSlab> slab_;
+    char *buffer_;              // 还没有写入过数据时为nullptr
+    size_t capacity_;
+    size_t initialSize_;
+    size_t readerIndex_;
+    size_t writerIndex_;
+};
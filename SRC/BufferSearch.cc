@@ -0,0 +1,170 @@
+#include "BufferSearch.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#ifdef MUDUO_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace buffersearch
+{
+
+const char* findByte(const char *begin, const char *end, char c)
+{
+    return static_cast<const char*>(::memchr(begin, c, end - begin));
+}
+
+const char* findCRLFScalar(const char *begin, const char *end)
+{
+    while (begin + 1 < end)
+    {
+        const char *cr = static_cast<const char*>(::memchr(begin, '\r', end - begin - 1));
+        if (cr == nullptr)
+        {
+            return nullptr;
+        }
+        if (cr[1] == '\n')
+        {
+            return cr;
+        }
+        begin = cr + 1;
+    }
+    return nullptr;
+}
+
+#ifdef MUDUO_X86_SIMD
+
+// 一次比较16字节，p[i]=='\r'的位图和p[i+1]=='\n'的位图相与，不需要逐个确认下一个字节，ctz取第一个命中的位置。
+// 主循环一次看64字节，先只找CR，整块没有CR时跳过（大块数据里分隔符很少），有CR时再和LF的位图相与
+__attribute__((target("sse2")))
+const char* findCRLFSSE2(const char *begin, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char *p = begin;
+    for (; p + 65 <= end; p += 64)
+    {
+        __m128i c0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), cr);
+        __m128i c1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), cr);
+        __m128i c2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), cr);
+        __m128i c3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), cr);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(c0, c1), _mm_or_si128(c2, c3))) == 0)
+        {
+            continue;
+        }
+        __m128i l0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1)), lf);
+        __m128i l1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 17)), lf);
+        __m128i l2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 33)), lf);
+        __m128i l3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 49)), lf);
+        uint64_t mask = static_cast<uint64_t>(_mm_movemask_epi8(_mm_and_si128(c0, l0)))
+                      | static_cast<uint64_t>(_mm_movemask_epi8(_mm_and_si128(c1, l1))) << 16
+                      | static_cast<uint64_t>(_mm_movemask_epi8(_mm_and_si128(c2, l2))) << 32
+                      | static_cast<uint64_t>(_mm_movemask_epi8(_mm_and_si128(c3, l3))) << 48;
+        if (mask)
+        {
+            return p + __builtin_ctzll(mask);
+        }
+    }
+    for (; p + 17 <= end; p += 16)
+    {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v0, cr), _mm_cmpeq_epi8(v1, lf)));
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findCRLFScalar(p, end);
+}
+
+// 和SSE2版本一样的结构，一次32字节
+__attribute__((target("avx2")))
+const char* findCRLFAVX2(const char *begin, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    for (; p + 65 <= end; p += 64)
+    {
+        __m256i c0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), cr);
+        __m256i c1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), cr);
+        __m256i any = _mm256_or_si256(c0, c1);
+        if (_mm256_testz_si256(any, any))
+        {
+            continue;
+        }
+        __m256i l0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1)), lf);
+        __m256i l1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 33)), lf);
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(c0, l0)))
+                      | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(c1, l1)))) << 32;
+        if (mask)
+        {
+            return p + __builtin_ctzll(mask);
+        }
+    }
+    for (; p + 33 <= end; p += 32)
+    {
+        __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(v0, cr), _mm256_cmpeq_epi8(v1, lf))));
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findCRLFSSE2(p, end);
+}
+
+#endif // MUDUO_X86_SIMD
+
+bool hasSSE2()
+{
+#ifdef MUDUO_X86_SIMD
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#else
+    return false;
+#endif
+}
+
+bool hasAVX2()
+{
+#ifdef MUDUO_X86_SIMD
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+namespace
+{
+
+// 通过CPUID选择当前CPU支持的最快实现
+FindCRLFFunc selectFindCRLF()
+{
+#ifdef MUDUO_X86_SIMD
+    if (hasAVX2())
+    {
+        return findCRLFAVX2;
+    }
+    if (hasSSE2())
+    {
+        return findCRLFSSE2;
+    }
+#endif
+    return findCRLFScalar;
+}
+
+} // namespace
+
+FindCRLFFunc bestFindCRLF()
+{
+    static const FindCRLFFunc find = selectFindCRLF();
+    return find;
+}
+
+} // namespace buffersearch
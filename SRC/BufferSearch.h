@@ -0,0 +1,35 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MUDUO_X86_SIMD 1
+#endif
+
+/**
+ * Buffer::findCRLF/findByte的实现，在[begin, end)中查找，找不到返回nullptr。
+ * 单独声明出来是为了测试和性能测试能逐个调用对比。
+ *
+ * 单字节查找直接用memchr：glibc的memchr本身就按CPUID选择SSE2/AVX2/EVEX实现，
+ * 实测比手写的SSE2/AVX2循环快（见bench/bench_BufferSearch.cc）。
+ * CRLF查找有标量、SSE2、AVX2三个版本，Buffer第一次查找时用bestFindCRLF按CPUID选一个；
+ * SSE2/AVX2版本只能在hasSSE2()/hasAVX2()为true时调用
+ */
+namespace buffersearch
+{
+
+using FindCRLFFunc = const char* (*)(const char *begin, const char *end);
+
+const char* findByte(const char *begin, const char *end, char c);
+
+const char* findCRLFScalar(const char *begin, const char *end);
+#ifdef MUDUO_X86_SIMD
+const char* findCRLFSSE2(const char *begin, const char *end);
+const char* findCRLFAVX2(const char *begin, const char *end);
+#endif
+
+bool hasSSE2();
+bool hasAVX2();
+
+// 当前CPU支持的最快实现
+FindCRLFFunc bestFindCRLF();
+
+} // namespace buffersearch
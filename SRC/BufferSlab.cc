@@ -0,0 +1,268 @@
+#include "BufferSlab.h"
+#include "CurrentThread.h"
+
+#include <stdlib.h>
+
+const int BufferSlab::kNumClasses;
+const size_t BufferSlab::kMinClassSize;
+const size_t BufferSlab::kMaxClassSize;
+
+namespace
+{
+const size_t kDefaultMaxCachedBytes = 16 * 1024 * 1024;    // 每个loop默认最多缓存16M
+
+// 只有一个写者的计数器，不需要原子的读改写
+template <typename T>
+void localAdd(std::atomic<T> &counter, T delta)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+template <typename T>
+void localMax(std::atomic<T> &target, T value)
+{
+    if (value > target.load(std::memory_order_relaxed))
+    {
+        target.store(value, std::memory_order_relaxed);
+    }
+}
+} // namespace
+
+BufferSlab::BufferSlab(pid_t ownerTid)
+    : ownerTid_(ownerTid)
+    , maxCachedBytes_(kDefaultMaxCachedBytes)
+    , remoteCachedBytes_(0)
+    , localBytes_(0)
+    , highWaterBytes_(0)
+    , bytesCached_(0)
+    , allocations_(0)
+    , deallocations_(0)
+    , heapAllocations_(0)
+    , remoteBytes_(0)
+    , remoteAllocations_(0)
+    , remoteDeallocations_(0)
+{
+    for (int i = 0; i < kNumClasses; ++i)
+    {
+        freeList_[i] = nullptr;
+        remoteFree_[i].store(nullptr, std::memory_order_relaxed);
+        localClassBlocks_[i].store(0, std::memory_order_relaxed);
+        classHighWater_[i].store(0, std::memory_order_relaxed);
+        remoteClassBlocks_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+BufferSlab::~BufferSlab()
+{
+    for (int i = 0; i < kNumClasses; ++i)
+    {
+        drainRemote(i);
+        FreeNode *node = freeList_[i];
+        while (node)
+        {
+            FreeNode *next = node->next;
+            ::free(node);
+            node = next;
+        }
+    }
+}
+
+int BufferSlab::sizeClass(size_t size)
+{
+    if (size > kMaxClassSize)
+    {
+        return -1;
+    }
+    int cls = 0;
+    size_t classSize = kMinClassSize;
+    while (classSize < size)
+    {
+        classSize <<= 1;
+        ++cls;
+    }
+    return cls;
+}
+
+bool BufferSlab::inOwnerThread() const
+{
+    return ownerTid_ == CurrentThread::tid();
+}
+
+void BufferSlab::localAllocated(int cls, size_t size)
+{
+    localAdd<uint64_t>(allocations_, 1);
+    localAdd<int64_t>(localBytes_, static_cast<int64_t>(size));
+    // 高水位只在loop线程上更新，其它线程的分配要等loop线程下一次分配时才体现出来
+    int64_t inUse = localBytes_.load(std::memory_order_relaxed) + remoteBytes_.load(std::memory_order_relaxed);
+    if (inUse > 0)
+    {
+        localMax<size_t>(highWaterBytes_, static_cast<size_t>(inUse));
+    }
+    if (cls >= 0)
+    {
+        localAdd<int64_t>(localClassBlocks_[cls], 1);
+        int64_t blocks = localClassBlocks_[cls].load(std::memory_order_relaxed)
+                       + remoteClassBlocks_[cls].load(std::memory_order_relaxed);
+        if (blocks > 0)
+        {
+            localMax<size_t>(classHighWater_[cls], static_cast<size_t>(blocks));
+        }
+    }
+}
+
+void BufferSlab::localFreed(int cls, size_t size)
+{
+    localAdd<uint64_t>(deallocations_, 1);
+    localAdd<int64_t>(localBytes_, -static_cast<int64_t>(size));
+    if (cls >= 0)
+    {
+        localAdd<int64_t>(localClassBlocks_[cls], -1);
+    }
+}
+
+void BufferSlab::remoteAllocated(int cls, size_t size)
+{
+    remoteAllocations_.fetch_add(1, std::memory_order_relaxed);
+    remoteBytes_.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+    if (cls >= 0)
+    {
+        remoteClassBlocks_[cls].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void BufferSlab::remoteFreed(int cls, size_t size)
+{
+    remoteDeallocations_.fetch_add(1, std::memory_order_relaxed);
+    remoteBytes_.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+    if (cls >= 0)
+    {
+        remoteClassBlocks_[cls].fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+char* BufferSlab::allocate(size_t *size)
+{
+    const int cls = sizeClass(*size);
+    if (cls >= 0)
+    {
+        *size = kMinClassSize << cls;
+    }
+    if (!inOwnerThread())   // 不在loop线程，不碰空闲链表
+    {
+        remoteAllocated(cls, *size);
+        return static_cast<char*>(::malloc(*size));
+    }
+
+    localAllocated(cls, *size);
+    if (cls >= 0)
+    {
+        if (!freeList_[cls])
+        {
+            drainRemote(cls);
+        }
+        FreeNode *node = freeList_[cls];
+        if (node)
+        {
+            freeList_[cls] = node->next;
+            localAdd<size_t>(bytesCached_, -*size);
+            return reinterpret_cast<char*>(node);
+        }
+    }
+    // 超过最大的size class，或者缓存没命中
+    localAdd<uint64_t>(heapAllocations_, 1);
+    return static_cast<char*>(::malloc(*size));
+}
+
+void BufferSlab::deallocate(char *p, size_t size)
+{
+    const int cls = sizeClass(size);
+    if (cls >= 0)
+    {
+        size = kMinClassSize << cls;
+    }
+    const size_t maxCached = maxCachedBytes_.load(std::memory_order_relaxed);
+    FreeNode *node = reinterpret_cast<FreeNode*>(p);
+    if (inOwnerThread())
+    {
+        localFreed(cls, size);
+        if (cls < 0 || bytesCached_.load(std::memory_order_relaxed) + size > maxCached)
+        {
+            ::free(p);
+            return;
+        }
+        node->next = freeList_[cls];
+        freeList_[cls] = node;
+        localAdd<size_t>(bytesCached_, size);
+        return;
+    }
+
+    // 不在loop线程，压到remote链表上（无锁栈），remote链表也不超过缓存上限
+    remoteFreed(cls, size);
+    if (cls < 0 || remoteCachedBytes_.fetch_add(size, std::memory_order_relaxed) + size > maxCached)
+    {
+        if (cls >= 0)
+        {
+            remoteCachedBytes_.fetch_sub(size, std::memory_order_relaxed);
+        }
+        ::free(p);
+        return;
+    }
+    node->next = remoteFree_[cls].load(std::memory_order_relaxed);
+    while (!remoteFree_[cls].compare_exchange_weak(node->next, node,
+                std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+}
+
+void BufferSlab::drainRemote(int cls)
+{
+    FreeNode *node = remoteFree_[cls].exchange(nullptr, std::memory_order_acquire);
+    const size_t size = kMinClassSize << cls;
+    const size_t maxCached = maxCachedBytes_.load(std::memory_order_relaxed);
+    size_t drained = 0;
+    while (node)
+    {
+        FreeNode *next = node->next;
+        drained += size;
+        // 收回来的块同样受缓存上限约束，超出的直接还给系统
+        if (bytesCached_.load(std::memory_order_relaxed) + size > maxCached)
+        {
+            ::free(node);
+        }
+        else
+        {
+            node->next = freeList_[cls];
+            freeList_[cls] = node;
+            localAdd<size_t>(bytesCached_, size);
+        }
+        node = next;
+    }
+    if (drained > 0)
+    {
+        remoteCachedBytes_.fetch_sub(drained, std::memory_order_relaxed);
+    }
+}
+
+BufferSlab::Stats BufferSlab::stats() const
+{
+    Stats s;
+    int64_t inUse = localBytes_.load(std::memory_order_relaxed) + remoteBytes_.load(std::memory_order_relaxed);
+    s.bytesInUse = inUse > 0 ? static_cast<size_t>(inUse) : 0;
+    s.highWaterBytes = highWaterBytes_.load(std::memory_order_relaxed);
+    s.bytesCached = bytesCached_.load(std::memory_order_relaxed)
+                  + remoteCachedBytes_.load(std::memory_order_relaxed);
+    s.remoteDeallocations = remoteDeallocations_.load(std::memory_order_relaxed);
+    s.allocations = allocations_.load(std::memory_order_relaxed)
+                  + remoteAllocations_.load(std::memory_order_relaxed);
+    s.deallocations = deallocations_.load(std::memory_order_relaxed) + s.remoteDeallocations;
+    s.heapAllocations = heapAllocations_.load(std::memory_order_relaxed)
+                      + remoteAllocations_.load(std::memory_order_relaxed);
+    for (int i = 0; i < kNumClasses; ++i)
+    {
+        int64_t blocks = localClassBlocks_[i].load(std::memory_order_relaxed)
+                       + remoteClassBlocks_[i].load(std::memory_order_relaxed);
+        s.classInUse[i] = blocks > 0 ? static_cast<size_t>(blocks) : 0;
+        s.classHighWater[i] = classHighWater_[i].load(std::memory_order_relaxed);
+    }
+    return s;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * 每个EventLoop一个的缓冲区内存分配器，按size class（1K 2K 4K ... 64K）缓存空闲块。
+ * loop线程上分配和回收都只操作本地的空闲链表，不加锁也不进malloc；
+ * 其它线程归还的块先压到无锁的remote链表里，等loop线程分配时再收回来。
+ * 统计计数分成两组：loop线程的计数只有它自己写，用relaxed的load+store更新，没有原子的读改写；
+ * 其它线程的分配、归还（少见的慢路径）另外用fetch_add计数，stats()把两组加起来。
+ * 块被谁持有，谁就持有slab的shared_ptr，所以slab可以比EventLoop活得久
+ */
+class BufferSlab : noncopyable
+{
+public:
+    static const int kNumClasses = 7;
+    static const size_t kMinClassSize = 1024;
+    static const size_t kMaxClassSize = kMinClassSize << (kNumClasses - 1); // 64K
+
+    // 使用情况的快照，任意线程都可以读
+    struct Stats
+    {
+        size_t bytesInUse;              // 分配出去还没有归还的字节数
+        size_t highWaterBytes;          // bytesInUse的历史最大值
+        size_t bytesCached;             // 空闲链表（包括remote链表）中缓存的字节数
+        uint64_t allocations;
+        uint64_t deallocations;
+        uint64_t remoteDeallocations;   // 由其它线程归还的次数
+        uint64_t heapAllocations;       // 缓存没命中、超过64K、或者不在loop线程，走了malloc的次数
+        size_t classInUse[kNumClasses];     // 每个size class分配出去的块数
+        size_t classHighWater[kNumClasses]; // 每个size class分配出去的块数的历史最大值
+    };
+
+    explicit BufferSlab(pid_t ownerTid);
+    ~BufferSlab();
+
+    // 分配至少*size字节，*size返回实际可用的大小（向上取整到size class）
+    char* allocate(size_t *size);
+    // size可以是申请时的大小，也可以是allocate返回的大小
+    void deallocate(char *p, size_t size);
+
+    // 空闲链表最多缓存的字节数，超出的部分直接还给系统（remote链表也不超过这个值）
+    void setMaxCachedBytes(size_t bytes) { maxCachedBytes_.store(bytes, std::memory_order_relaxed); }
+
+    Stats stats() const;
+private:
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    // 返回size所属的size class，超过kMaxClassSize返回-1
+    static int sizeClass(size_t size);
+    bool inOwnerThread() const;
+    // 把其它线程归还的块收到本地空闲链表
+    void drainRemote(int cls);
+    // loop线程上记录一次分配/归还（cls为-1表示超过最大size class的块）
+    void localAllocated(int cls, size_t size);
+    void localFreed(int cls, size_t size);
+    // 其它线程上记录一次分配/归还
+    void remoteAllocated(int cls, size_t size);
+    void remoteFreed(int cls, size_t size);
+
+    const pid_t ownerTid_;
+    std::atomic<size_t> maxCachedBytes_;
+
+    FreeNode *freeList_[kNumClasses];                   // 只有loop线程访问
+    std::atomic<FreeNode*> remoteFree_[kNumClasses];    // 其它线程归还的块
+    std::atomic<size_t> remoteCachedBytes_;             // remote链表上的字节数
+
+    // 只有loop线程写
+    std::atomic<int64_t> localBytes_;           // loop线程分配的字节数 - loop线程归还的字节数
+    std::atomic<size_t> highWaterBytes_;
+    std::atomic<size_t> bytesCached_;
+    std::atomic<uint64_t> allocations_;
+    std::atomic<uint64_t> deallocations_;
+    std::atomic<uint64_t> heapAllocations_;
+    std::atomic<int64_t> localClassBlocks_[kNumClasses];
+    std::atomic<size_t> classHighWater_[kNumClasses];
+
+    // 其它线程用fetch_add更新
+    std::atomic<int64_t> remoteBytes_;
+    std::atomic<uint64_t> remoteAllocations_;   // 都是malloc
+    std::atomic<uint64_t> remoteDeallocations_;
+    std::atomic<int64_t> remoteClassBlocks_[kNumClasses];
+};
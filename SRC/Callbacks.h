@@ -4,6 +4,7 @@
 #include <functional>
 
 class Buffer;
+class ChainBuffer;
 class TcpConnection;
 class Timestamp;
 
@@ -14,4 +15,9 @@ using WriteCompleteCallback = std::function<void (const TcpConnectionPtr&)>;
 using MessageCallback = std::function<void (const TcpConnectionPtr&,
                                         Buffer*,
                                         Timestamp)>;
-using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
\ No newline at end of file
+// 分段缓冲区模式下的消息回调，ChainBuffer里的块可以零拷贝地转发给其它连接
+using ChainMessageCallback = std::function<void (const TcpConnectionPtr&,
+                                        ChainBuffer*,
+                                        Timestamp)>;
+using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+using TimerCallback = std::function<void()>;
@@ -0,0 +1,292 @@
+#include "ChainBuffer.h"
+#include "Buffer.h"
+#include "BufferSlab.h"
+
+#include <new>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+const size_t BufferBlock::kBlockSize;
+
+namespace
+{
+
+const size_t kMaxReadBytes = 65536;     // readFd一次最多读64K
+const int kMaxFreshBlocks = (kMaxReadBytes + BufferBlock::kBlockSize - 1) / BufferBlock::kBlockSize;
+const int kMaxIov = 64;                 // writeFd一次最多提交的块数
+
+} // namespace
+
+static_assert(sizeof(BufferBlock) <= 16 * 1024, "BufferBlock must fit in the 16K size class");
+
+BlockRef BlockRef::allocate(const std::shared_ptr<BufferSlab> &slab)
+{
+    size_t size = sizeof(BufferBlock);
+    char *p = slab ? slab->allocate(&size) : static_cast<char*>(::malloc(size));
+    BufferBlock *block = new (p) BufferBlock;
+    block->refs.store(1, std::memory_order_relaxed);
+    block->used = 0;
+    block->slab = slab;
+    return BlockRef(block);
+}
+
+void BlockRef::unref()
+{
+    if (block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        std::shared_ptr<BufferSlab> slab;
+        slab.swap(block_->slab);
+        block_->~BufferBlock();
+        if (slab)
+        {
+            slab->deallocate(reinterpret_cast<char*>(block_), sizeof(BufferBlock));
+        }
+        else
+        {
+            ::free(block_);
+        }
+    }
+    block_ = nullptr;
+}
+
+size_t ChainBuffer::tailWritable() const
+{
+    if (slices_.empty())
+    {
+        return 0;
+    }
+    const Slice &tail = slices_.back();
+    if (tail.offset + tail.len != tail.block->used || !tail.block.unique())
+    {
+        return 0;
+    }
+    return BufferBlock::kBlockSize - tail.block->used;
+}
+
+void ChainBuffer::append(const char *data, size_t len)
+{
+    readable_ += len;
+
+    size_t n = std::min(tailWritable(), len);
+    if (n > 0)
+    {
+        Slice &tail = slices_.back();
+        ::memcpy(tail.block->data + tail.block->used, data, n);
+        tail.block->used += n;
+        tail.len += n;
+        data += n;
+        len -= n;
+    }
+
+    while (len > 0)
+    {
+        Slice slice;
+        slice.block = BlockRef::allocate(slab_);
+        slice.offset = 0;
+        slice.len = std::min(len, BufferBlock::kBlockSize);
+        ::memcpy(slice.block->data, data, slice.len);
+        slice.block->used = slice.len;
+        data += slice.len;
+        len -= slice.len;
+        slices_.push_back(std::move(slice));
+    }
+}
+
+void ChainBuffer::append(const ChainBuffer &rhs)
+{
+    for (const Slice &slice : rhs.slices_)
+    {
+        slices_.push_back(slice);
+    }
+    readable_ += rhs.readable_;
+}
+
+void ChainBuffer::appendAndClear(ChainBuffer *rhs)
+{
+    if (slices_.empty())
+    {
+        swap(*rhs);
+        return;
+    }
+    for (Slice &slice : rhs->slices_)
+    {
+        slices_.push_back(std::move(slice));
+    }
+    readable_ += rhs->readable_;
+    rhs->retrieveAll();
+}
+
+ChainBuffer ChainBuffer::slice(size_t len) const
+{
+    ChainBuffer result;
+    for (const Slice &slice : slices_)
+    {
+        if (len == 0)
+        {
+            break;
+        }
+        Slice part = slice;
+        part.len = std::min(part.len, len);
+        len -= part.len;
+        result.readable_ += part.len;
+        result.slices_.push_back(std::move(part));
+    }
+    return result;
+}
+
+void ChainBuffer::retrieve(size_t len)
+{
+    if (len >= readable_)
+    {
+        retrieveAll();
+        return;
+    }
+    readable_ -= len;
+    while (len > 0)
+    {
+        Slice &head = slices_.front();
+        if (len < head.len)
+        {
+            head.offset += len;
+            head.len -= len;
+            break;
+        }
+        len -= head.len;
+        slices_.pop_front();    // 块的引用计数减一，归零后回到块池
+    }
+}
+
+size_t ChainBuffer::numBlocks() const
+{
+    // 同一个块的各段在链上总是相邻的（只会在链尾追加），和前一段比较就能去重
+    size_t n = 0;
+    const BufferBlock *last = nullptr;
+    for (const Slice &slice : slices_)
+    {
+        if (slice.block.get() != last)
+        {
+            last = slice.block.get();
+            ++n;
+        }
+    }
+    return n;
+}
+
+size_t ChainBuffer::copyOut(char *dst, size_t len) const
+{
+    size_t copied = 0;
+    for (const Slice &slice : slices_)
+    {
+        if (copied == len)
+        {
+            break;
+        }
+        size_t n = std::min(slice.len, len - copied);
+        ::memcpy(dst + copied, slice.block->data + slice.offset, n);
+        copied += n;
+    }
+    return copied;
+}
+
+void ChainBuffer::appendTo(Buffer *buf) const
+{
+    buf->ensureWriteableBytes(readable_);
+    for (const Slice &slice : slices_)
+    {
+        buf->append(slice.block->data + slice.offset, slice.len);
+    }
+}
+
+std::string ChainBuffer::retrieveAllAsString()
+{
+    std::string result(readable_, '\0');
+    copyOut(&result[0], readable_);     // readable_为0时&result[0]指向结尾的'\0'，不会解引用end()
+    retrieveAll();
+    return result;
+}
+
+/**
+ * 先填满尾块剩余的空间，不够64K的部分用块池里的新块补上，一次readv读进来，
+ * 读到数据的新块挂到链尾，没用上的新块析构时直接回到块池
+ */
+ssize_t ChainBuffer::readFd(int fd, int *saveErrno)
+{
+    struct iovec vec[1 + kMaxFreshBlocks];
+    BlockRef fresh[kMaxFreshBlocks];
+    int iovcnt = 0;
+
+    const size_t writable = tailWritable();
+    if (writable > 0)
+    {
+        BufferBlock *tail = slices_.back().block.get();
+        vec[iovcnt].iov_base = tail->data + tail->used;
+        vec[iovcnt].iov_len = writable;
+        ++iovcnt;
+    }
+
+    int nfresh = 0;
+    for (size_t total = writable; total < kMaxReadBytes && nfresh < kMaxFreshBlocks;
+            total += BufferBlock::kBlockSize)
+    {
+        fresh[nfresh] = BlockRef::allocate(slab_);
+        vec[iovcnt].iov_base = fresh[nfresh]->data;
+        vec[iovcnt].iov_len = BufferBlock::kBlockSize;
+        ++iovcnt;
+        ++nfresh;
+    }
+
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+        return n;
+    }
+
+    size_t remaining = n;
+    readable_ += remaining;
+    if (writable > 0)
+    {
+        size_t m = std::min(remaining, writable);
+        Slice &tail = slices_.back();
+        tail.block->used += m;
+        tail.len += m;
+        remaining -= m;
+    }
+    for (int i = 0; i < nfresh && remaining > 0; ++i)
+    {
+        Slice slice;
+        slice.len = std::min(remaining, BufferBlock::kBlockSize);
+        slice.offset = 0;
+        fresh[i]->used = slice.len;
+        slice.block = std::move(fresh[i]);
+        remaining -= slice.len;
+        slices_.push_back(std::move(slice));
+    }
+    return n;
+}
+
+ssize_t ChainBuffer::writeFd(int fd, int *saveErrno) const
+{
+    struct iovec vec[kMaxIov];
+    int iovcnt = 0;
+    for (const Slice &slice : slices_)
+    {
+        if (iovcnt == kMaxIov)
+        {
+            break;
+        }
+        vec[iovcnt].iov_base = slice.block->data + slice.offset;
+        vec[iovcnt].iov_len = slice.len;
+        ++iovcnt;
+    }
+
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+class Buffer;
+class BufferSlab;
+
+// 固定大小的内存块，由引用计数管理，多个ChainBuffer可以共享同一个块（零拷贝转发）
+struct BufferBlock
+{
+    static const size_t kBlockSize = 16 * 1024 - 64;  // 加上块头正好占用BufferSlab中16K的size class
+
+    std::atomic_int refs;   // 引用计数（块可能被不同loop线程上的连接共享）
+    size_t used;            // 已经写入的字节数，只有唯一持有者能继续往后写
+    std::shared_ptr<BufferSlab> slab;   // 块从哪个slab分配的，引用计数归零时还回去（nullptr表示malloc）
+    char data[kBlockSize];
+};
+
+// 对BufferBlock的引用计数句柄
+class BlockRef
+{
+public:
+    BlockRef() : block_(nullptr) {}
+    explicit BlockRef(BufferBlock *block) : block_(block) {}  // 接管一个refs==1的新块
+    BlockRef(const BlockRef &rhs) : block_(rhs.block_) { ref(); }
+    BlockRef(BlockRef &&rhs) : block_(rhs.block_) { rhs.block_ = nullptr; }
+    ~BlockRef() { unref(); }
+
+    BlockRef& operator=(BlockRef rhs) { std::swap(block_, rhs.block_); return *this; }
+
+    BufferBlock* get() const { return block_; }
+    BufferBlock* operator->() const { return block_; }
+    bool unique() const { return block_->refs.load(std::memory_order_acquire) == 1; }
+
+    // 从slab中取出一个空块，slab为空时用malloc
+    static BlockRef allocate(const std::shared_ptr<BufferSlab> &slab);
+private:
+    void ref() { if (block_) block_->refs.fetch_add(1, std::memory_order_relaxed); }
+    void unref();
+
+    BufferBlock *block_;
+};
+
+/**
+ * 分段缓冲区：由固定大小的块组成的链表，数据增长时只追加新块，
+ * 不会像Buffer那样整体realloc和memmove。
+ * 每一段(Slice)引用一个块中的[offset, offset+len)，slice()/append(const ChainBuffer&)
+ * 只增加块的引用计数，可以把一个连接inputBuffer中的数据零拷贝地交给另一个连接发送
+ */
+class ChainBuffer
+{
+public:
+    explicit ChainBuffer(const std::shared_ptr<BufferSlab> &slab = std::shared_ptr<BufferSlab>())
+        : slab_(slab), readable_(0)
+    {}
+
+    size_t readableBytes() const { return readable_; }
+    size_t numSlices() const { return slices_.size(); }
+    // 引用的不同块的个数（一个块可能被切成相邻的几段）
+    size_t numBlocks() const;
+
+    // 只交换数据，新块从哪个slab分配不变
+    void swap(ChainBuffer &rhs)
+    {
+        slices_.swap(rhs.slices_);
+        std::swap(readable_, rhs.readable_);
+    }
+
+    // 拷贝数据到链尾，尾块写满后从slab中取新块
+    void append(const char *data, size_t len);
+    void append(const std::string &str) { append(str.data(), str.size()); }
+
+    // 共享rhs中的所有块（不拷贝数据）
+    void append(const ChainBuffer &rhs);
+    // 把rhs中的块整体挪过来，rhs变空
+    void appendAndClear(ChainBuffer *rhs);
+
+    // 返回前len字节的一个零拷贝视图
+    ChainBuffer slice(size_t len) const;
+
+    void retrieve(size_t len);
+    void retrieveAll() { slices_.clear(); readable_ = 0; }
+
+    // 拷贝前len个字节到dst，返回实际拷贝的字节数，不移动读位置
+    size_t copyOut(char *dst, size_t len) const;
+    // 拷贝全部可读数据到Buffer中（给只认识Buffer的MessageCallback用）
+    void appendTo(Buffer *buf) const;
+    std::string retrieveAllAsString();
+
+    // 从fd上读取数据：尾块剩余空间 + 新块（共64K），一次readv
+    ssize_t readFd(int fd, int *saveErrno);
+    // 用writev把链上的块发送出去，不移动读位置（调用者再retrieve）
+    ssize_t writeFd(int fd, int *saveErrno) const;
+private:
+    struct Slice
+    {
+        BlockRef block;
+        size_t offset;
+        size_t len;
+    };
+
+    // 尾块是否还能继续写：块只被自己引用，且这一段正好在块的写入末尾
+    size_t tailWritable() const;
+
+    std::shared_ptr<BufferSlab> slab_;  // 新块从这里分配
+    std::deque<Slice> slices_;
+    size_t readable_;
+};
@@ -10,7 +10,7 @@ const int Channel::kWriteEvent = EPOLLOUT;
 
 // EventLoop: ChannelList Poller
 Channel::Channel(EventLoop* loop, int fd)
-    :loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), tied_(false)
+    :loop_(loop), fd_(fd), events_(0), revents_(0), index_(-1), edgeTriggered_(false), tied_(false)
 {
 }
 
@@ -31,13 +31,13 @@ void Channel::tie(const std::shared_ptr<void>& obj)
 void Channel::update()
 {
     // 通过channel所属的EventLoop，调用poller的相应方法，注册fd的events事件
-    // loop_updateChannel(this);
+    loop_->updateChannel(this);
 }
 
 // 在Channel所属的Eventloop中，把当前的channel删除掉
 void Channel::remove()
 {
-    // loop_removeChannel(this);
+    loop_->removeChannel(this);
 }
 
 // 用于：fd得到poller的通知后，处理相关事件
@@ -51,6 +51,11 @@ public:
     bool isWriting() const { return events_ & kWriteEvent; }
     bool isReading() const { return events_ & kReadEvent; }
 
+    // 边沿触发：EPollPoller注册时带上EPOLLET，下一次update时生效。
+    // 只有事件状态变化时才通知，回调要自己读写到EAGAIN（poll/io_uring后端忽略这个标志）
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    bool edgeTriggered() const { return edgeTriggered_; }
+
     int index() { return index_; }
     void set_index(int idx) { index_ = idx; }
 
@@ -71,6 +76,7 @@ private:
     int events_;                    // fd感兴趣的事件类型集合
     int revents_;                   // 事件监听器实际监听到该fd发生的事件类型集合
     int index_;                     // 事件状态
+    bool edgeTriggered_;            // 是否以EPOLLET注册
 
     std::weak_ptr<void> tie_;
     bool tied_;
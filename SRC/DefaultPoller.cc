@@ -1,5 +1,8 @@
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "PollPoller.h"
+#include "UringPoller.h"
+#include "Logger.h"
 
 #include <stdlib.h>
 
@@ -8,9 +11,15 @@ Poller* Poller::newDefaultPoller(EventLoop* loop)
 {
     if(::getenv("MUDUO_USE_POLL"))
     {
-        return nullptr;     // 生成poll实例
+        return new PollPoller(loop);    // 生成poll实例
     }
-    else{
-        return new EPollPoller(loop);     // 生成epoll实例
+    else if(::getenv("MUDUO_USE_URING"))
+    {
+        if(UringPoller::available())
+        {
+            return new UringPoller(loop);   // 生成io_uring实例
+        }
+        LOG_ERROR("io_uring is not available, fall back to epoll \n");
     }
+    return new EPollPoller(loop);     // 生成epoll实例
 }
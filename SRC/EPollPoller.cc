@@ -11,10 +11,22 @@ const int kNew = -1;    // 一个channel还没有添加到poller之中
 const int kAdded = 1;   // 一 个channel已经添加到poller之中
 const int kDeleted = 2; // 一个channel已经在poller之中删除
 
+// channel要注册到内核的事件掩码
+static uint32_t epollEvents(const Channel *channel)
+{
+    uint32_t events = channel->events();
+    if(channel->edgeTriggered())
+    {
+        events |= EPOLLET;
+    }
+    return events;
+}
+
 EPollPoller::EPollPoller(EventLoop *loop)
     : Poller(loop)
     , epollfd_(::epoll_create1(EPOLL_CLOEXEC))
     , events_(kInitEventListSize)  // vector<epoll_event>
+    , lowUsagePolls_(0)
 {
     if (epollfd_ < 0)
         LOG_FATAL("epoll_create error:%d \n", errno);
@@ -28,9 +40,10 @@ EPollPoller::~EPollPoller()
 // 主要作用是调用epoll_wait
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
-    // LOG_DEBUG更为合理，此处用INFO为了方便看到结果
-    LOG_INFO("func=%s => fd total count:%lu\n", __FUNCTION__, channels_.size());
+    // busy-poll模式下会以0超时反复调用，每次都打INFO日志开销太大
+    LOG_DEBUG("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels());
 
+    applyPendingUpdates();
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(),
                             static_cast<int>(events_.size()), timeoutMs);
     int saveErrno = errno;
@@ -38,16 +51,14 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 
     if(numEvents > 0)
     {
-        LOG_INFO("%d events happend \n", numEvents);
+        LOG_DEBUG("%d events happend \n", numEvents);
         fillActiveChannels(numEvents, activeChannels);   
-        if(numEvents == events_.size())  // 说明所有的事件都发生了，需要扩容
-        {   
-            events_.resize(events_.size() * 2);
-        }
+        adjustEventList(numEvents);
     }
     else if(numEvents == 0)  // timeout超时
     {
         LOG_DEBUG("%s timeout! \n", __FUNCTION__);
+        adjustEventList(numEvents);
     }
     else                     // 发生了错误
     {           
@@ -60,11 +71,35 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
     return now;
 }
 
+void EPollPoller::adjustEventList(int numEvents)
+{
+    const size_t size = events_.size();
+    if(static_cast<size_t>(numEvents) == size)  // 说明所有的事件都发生了，需要扩容
+    {
+        events_.resize(size * 2);
+        lowUsagePolls_ = 0;
+    }
+    else if(size > kInitEventListSize && static_cast<size_t>(numEvents) <= size / 4)
+    {
+        // 突发过后活跃连接少了，不能一直占着大数组
+        if(++lowUsagePolls_ >= kShrinkAfterPolls)
+        {
+            events_.resize(size / 2);
+            events_.shrink_to_fit();
+            lowUsagePolls_ = 0;
+        }
+    }
+    else
+    {
+        lowUsagePolls_ = 0;
+    }
+}
+
 // channel update => EventLoop updateChannel => Poller updateChannel
 void EPollPoller::updateChannel(Channel *channel)
 {
     const int index = channel->index();
-    LOG_INFO("func=%s => fd=%d events=%d index=%d \n",
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n",
          __FUNCTION__, channel->fd(), channel->events(), index);
     
     // 新加入或者已删除
@@ -73,7 +108,7 @@ void EPollPoller::updateChannel(Channel *channel)
         if(index == kNew)
         {
             int fd = channel->fd();
-            channels_[fd] = channel;
+            addChannel(fd, channel);
         }
         channel->set_index(kAdded);
         update(EPOLL_CTL_ADD, channel);
@@ -86,20 +121,77 @@ void EPollPoller::updateChannel(Channel *channel)
             update(EPOLL_CTL_DEL, channel);
             channel->set_index(kDeleted);
         }
-        else                       // 换了感兴趣的事件
+        else                       // 换了感兴趣的事件，等到epoll_wait之前再MOD
+        {
+            Interest &st = interest(fd);
+            uint32_t events = epollEvents(channel);
+            if(channel->edgeTriggered() && (events & ~st.requested))
+            {
+                st.rearm = true;
+            }
+            st.requested = events;
+            if(st.dirty)
+            {
+                countCtlAvoided();  // 和本轮之前的修改合并
+            }
+            else
+            {
+                st.dirty = true;
+                dirtyFds_.push_back(fd);
+            }
+        }
+    }
+}
+
+void EPollPoller::applyPendingUpdates()
+{
+    for(int fd : dirtyFds_)
+    {
+        Interest &st = interests_[fd];
+        if(!st.dirty)
+        {
+            continue;   // 之后又被ADD/DEL过了
+        }
+        st.dirty = false;
+        Channel *channel = findChannel(fd);
+        if(channel == nullptr || channel->index() != kAdded)
+        {
+            continue;
+        }
+        if(epollEvents(channel) != st.registered || st.rearm)
         {
             update(EPOLL_CTL_MOD, channel);
         }
+        else
+        {
+            countCtlAvoided();  // 改来改去又改回了内核里的掩码
+        }
+        st.rearm = false;
+    }
+    dirtyFds_.clear();
+}
+
+EPollPoller::Interest& EPollPoller::interest(int fd)
+{
+    if(static_cast<size_t>(fd) >= interests_.size())
+    {
+        size_t size = interests_.size() * 2;
+        if(size <= static_cast<size_t>(fd))
+        {
+            size = fd + 1;
+        }
+        interests_.resize(size, Interest{0, 0, false, false});
     }
+    return interests_[fd];
 }
 
 // channel remove => EventLoop removeChannel => Poller removeChannel
 void EPollPoller::removeChannel(Channel *channel)
 {
     int fd = channel->fd();
-    channels_.erase(fd);
+    eraseChannel(fd);
 
-    LOG_INFO("func=%s => fd=%d \n", __FUNCTION__, fd);
+    LOG_DEBUG("func=%s => fd=%d \n", __FUNCTION__, fd);
 
     int index = channel->index();
     if(index == kAdded)         // 如果是已加过的，则在epoll中也需要删除
@@ -127,10 +219,17 @@ void EPollPoller::update(int operation, Channel *channel)
 
     int fd = channel->fd();
 
-    event.events = channel->events();
+    event.events = epollEvents(channel);
     event.data.fd = fd;
     event.data.ptr = channel;
-    
+
+    // ADD、DEL之后之前攒下的MOD作废，ADD按当前的掩码注册
+    Interest &st = interest(fd);
+    st.dirty = false;
+    st.rearm = false;
+    st.registered = operation == EPOLL_CTL_DEL ? 0 : event.events;
+    st.requested = st.registered;
+    countCtlCall();
 
     if(::epoll_ctl(epollfd_, operation, fd, &event) < 0)
     {
@@ -22,10 +22,16 @@ public:
 
     // 重写基类Poller的抽象方法
     Timestamp poll(int timeoutMs, ChannelList *activeChannels) override; // epoll_wait
+    /**
+     * 已注册的channel修改感兴趣的事件时不立即epoll_ctl(MOD)，只记下来，
+     * 到下一次epoll_wait之前和内核里注册的掩码比较，有变化才MOD一次。
+     * 一轮里反复开关EPOLLOUT的连接最多一次系统调用，开了又关的一次也不用。ADD和DEL立即执行
+     */
     void updateChannel(Channel *channel) override;  // 调用update 
     void removeChannel(Channel *channel) override;  // epoll_ctl  del
 private:
     static const int kInitEventListSize = 16;       // EventList的初始长度
+    static const int kShrinkAfterPolls = 64;        // 连续这么多次poll都用不到四分之一，EventList减半
 
     // 填写活跃的连接
     void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
@@ -34,6 +40,24 @@ private:
 
     using EventList = std::vector<epoll_event>;
 
+    // 按最近的poll结果调整events_的长度：一次填满就扩容，长期用不满就缩小
+    void adjustEventList(int numEvents);
+    // 把攒下来的MOD交给内核
+    void applyPendingUpdates();
+
+    // 每个fd在内核里注册的事件掩码，以fd为下标
+    struct Interest
+    {
+        uint32_t registered;    // 最近一次epoll_ctl注册的掩码
+        uint32_t requested;     // 最近一次updateChannel要求的掩码
+        bool dirty;             // 在dirtyFds_里，等着下一次epoll_wait之前处理
+        bool rearm;             // 边沿触发的channel新打开过事件，即使掩码最后没变也要MOD，重新检查就绪状态
+    };
+    Interest& interest(int fd);
+
     int epollfd_;
     EventList events_;
+    int lowUsagePolls_;     // 连续用不到四分之一的poll次数
+    std::vector<Interest> interests_;
+    std::vector<int> dirtyFds_;
 };
\ No newline at end of file
@@ -2,6 +2,9 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "BufferSlab.h"
+#include "TimerQueue.h"
+#include "TimingWheel.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
@@ -17,7 +20,23 @@ __thread EventLoop* t_loopInThisThread = nullptr;
 // 定义默认的Poller IO复用接口的超时时间（10s）
 const int kPoolTimeMs = 10000;
 
+// 清理回调的执行间隔（1s）
+const int kSweepIntervalMs = 1000;
+
+const size_t EventLoop::kDefaultLowPriorityBudget;
+
+// 时间轮一个tick的长度（100ms），空闲超时的精度
+const double kTimingWheelTickSeconds = 0.1;
+
+// 两个时间点之间的微秒数，时钟回拨时记为0
+static uint64_t elapsedUs(Timestamp start, Timestamp end)
+{
+    int64_t diff = end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+    return diff > 0 ? static_cast<uint64_t>(diff) : 0;
+}
+
 // 创建wakeupfd，用来唤醒subReactor处理新来的channel
+
 int createEventfd()
 {
     int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
@@ -31,12 +50,23 @@ int createEventfd()
 EventLoop::EventLoop()
     : looping_(false)
     , quit_(false)
-    , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
+    , iteration_(0)
     , poller_(Poller::newDefaultPoller(this))
+    , timerQueue_(new TimerQueue(this))
+    , bufferSlab_(std::make_shared<BufferSlab>(threadId_))
     , wakeupFd_(createEventfd())
+    , wakeupPending_(false)
+    , numPosts_(0)
+    , numWakeups_(0)
+    , busyPollUs_(0)
     , wakeupChannel_(new Channel(this, wakeupFd_)) 
+    , busySince_(0)
     , currentActiveChannel_(nullptr)
+    , callingPendingFunctors_(false)
+    , lowPriorityBudget_(kDefaultLowPriorityBudget)
+    , lowPriorityBacklog_(false)
+    , callingIterationEndFunctors_(false)
 {
     LOG_DEBUG("EventLoop created %p in thread %d\n", this, threadId_);
     if(t_loopInThisThread)      // 当前线程已经有一个Loop了
@@ -53,6 +83,12 @@ EventLoop::EventLoop()
     wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
     // 每一个eventloop都将监听wakeupchannel的EPOLLIN读时间
     wakeupChannel_->enableReading();
+
+    for (FunctorLane &lane : lanes_)
+    {
+        lane.size.store(0, std::memory_order_relaxed);
+    }
+    sweepList_.prev = sweepList_.next = &sweepList_;
 }
 
 EventLoop::~EventLoop()
@@ -60,6 +96,14 @@ EventLoop::~EventLoop()
     wakeupChannel_->disableAll();
     wakeupChannel_->remove();
     ::close(wakeupFd_);
+    // 没来得及执行的回调直接释放
+    for (FunctorLane &lane : lanes_)
+    {
+        while (MpscNode *node = lane.queue.pop())
+        {
+            delete static_cast<FunctorNode*>(node);
+        }
+    }
     t_loopInThisThread = nullptr;
 }
 
@@ -74,13 +118,28 @@ void EventLoop::loop()
     {
         activeChannels_.clear();
         // 监听两类fd（client_td和wakeup_fd）
-        pollReturnTime_ = poller_->poll(kPoolTimeMs, &activeChannels_);
+        // 有清理回调时，最多阻塞kSweepIntervalMs，保证空闲的loop也能按时清理
+        // 还有上一轮没执行完的低优先级回调时不阻塞
+        const int timeoutMs = lowPriorityBacklog_ ? 0
+                            : sweepList_.next == &sweepList_ ? kPoolTimeMs : kSweepIntervalMs;
+        const Timestamp pollStart(Timestamp::now());
+        busySince_.store(0, std::memory_order_relaxed);
+        pollReturnTime_ = busyPollUs_.load(std::memory_order_relaxed) > 0
+                        ? busyPoll(timeoutMs)
+                        : poller_->poll(timeoutMs, &activeChannels_);
+        busySince_.store(pollReturnTime_.microSecondsSinceEpoch(), std::memory_order_relaxed);
+        // loop已经醒了，本轮的doPendingFunctors一定会取队列，这期间的投递不用再写eventfd
+        wakeupPending_.store(true, std::memory_order_release);
+        pollWaitUs_.record(elapsedUs(pollStart, pollReturnTime_));
+        activeChannelsHist_.record(activeChannels_.size());
         for(Channel* channel : activeChannels_) // 遍历所有发生事件
         {
             // Poller能够监听那些channel发生了事件，然后上报给EventLoop，
             // 通知channel处理相应的事件
             channel->handleEvent(pollReturnTime_);
         }
+        const Timestamp functorsStart(Timestamp::now());
+        handleEventUs_.record(elapsedUs(pollReturnTime_, functorsStart));
         // 执行当前EventLoop事件循环需要处理的回调操作
         /**
          * IO线程 [mainLoop] -accept-> [新用户] -返回-> [fd] <-打包- [channel] -分发-> [subLoop]
@@ -88,11 +147,51 @@ void EventLoop::loop()
          * wakeup subloop后，执行之前mainloop注册的cb操作 
         */
         doPendingFunctors();
+        doFunctorsUs_.record(elapsedUs(functorsStart, Timestamp::now()));
+        iteration_.store(iteration_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        doSweep();
     }
     LOG_INFO("EventLoop %p stop looping. \n", this);
     looping_ = false;
 }
 
+Timestamp EventLoop::busyPoll(int timeoutMs)
+{
+    // 空转期间标记成"醒着"，投递方只入队不写eventfd，由这里检查队列
+    wakeupPending_.store(true, std::memory_order_release);
+    const int64_t budget = busyPollUs_.load(std::memory_order_relaxed);
+    const Timestamp start(Timestamp::now());
+    while (!quit_)
+    {
+        Timestamp now = poller_->poll(0, &activeChannels_);
+        if (!activeChannels_.empty() || pendingFunctorCount() > 0)
+        {
+            return now;
+        }
+        if (now.microSecondsSinceEpoch() - start.microSecondsSinceEpoch() >= budget)
+        {
+            break;
+        }
+    }
+
+    // 阻塞之前清掉标志，再看一次队列：标志清掉之前入队的投递方没有写eventfd
+    wakeupPending_.exchange(false, std::memory_order_acq_rel);
+    if (quit_ || pendingFunctorCount() > 0)
+    {
+        return Timestamp::now();
+    }
+    return poller_->poll(timeoutMs, &activeChannels_);
+}
+
+void EventLoop::setBusyPoll(int budgetUs)
+{
+    busyPollUs_.store(budgetUs > 0 ? budgetUs : 0, std::memory_order_relaxed);
+    if (!isInLoopThread())
+    {
+        wakeup();   // loop可能正阻塞在poll上，让它按新的设置重新进入
+    }
+}
+
 // 两种情况：1、loop在自己的线程中调用quit;  2、在非loop的线程中，调用loop的quit
 /**
  *             mainLoop
@@ -110,7 +209,7 @@ void EventLoop::quit()
     }
 }
 
-void EventLoop::runInLoop(Functor cb)
+void EventLoop::runInLoop(Functor cb, Priority priority)
 {
     if(isInLoopThread())    // 在当前loop线程中执行cb
     {
@@ -118,16 +217,17 @@ void EventLoop::runInLoop(Functor cb)
     }
     else     // 在非当前loop线程中执行cb，就需要唤醒loop所在线程，执行cb
     {
-        queueInLoop(cb);
+        queueInLoop(std::move(cb), priority);
     }
 }
 
-void EventLoop::queueInLoop(Functor cb)
+void EventLoop::queueInLoop(Functor cb, Priority priority)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);     // 直接构造（push_back是拷贝构造）
-    }
+    // 移动进队列，不拷贝回调绑定的数据；先计数再push，doPendingFunctors按计数取
+    FunctorLane &lane = lanes_[priority];
+    lane.size.fetch_add(1, std::memory_order_relaxed);
+    lane.queue.push(new FunctorNode(std::move(cb)));
+    numPosts_.fetch_add(1, std::memory_order_relaxed);
 
     // 唤醒相应的需要执行上面回调操作的loop
     // 不在当前线程 || （当前loop正在执行回调，但是又有了新的回调）
@@ -150,6 +250,12 @@ void EventLoop::handleRead()
 // 向wakeupfd写一个数据，wakeupChannel就会发生读事件，当前（阻塞的）loop线程空就会被唤醒
 void EventLoop::wakeup()
 {
+    // 一连串的投递只有第一个真正写eventfd
+    if(wakeupPending_.exchange(true, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    numWakeups_.fetch_add(1, std::memory_order_relaxed);
     uint64_t one = 1;
     ssize_t n = write(wakeupFd_, &one, sizeof one);
     if(n != sizeof one)
@@ -158,6 +264,56 @@ void EventLoop::wakeup()
     }
 }
 
+LoopStats EventLoop::stats() const
+{
+    LoopStats stats;
+    stats.iterations = iteration_.load(std::memory_order_relaxed);
+    stats.posts = numPosts_.load(std::memory_order_relaxed);
+    stats.wakeups = numWakeups_.load(std::memory_order_relaxed);
+    stats.queueSize = pendingFunctorCount();
+    int64_t busySince = busySince_.load(std::memory_order_relaxed);
+    stats.busyUs = busySince > 0 ? static_cast<int64_t>(elapsedUs(Timestamp(busySince), Timestamp::now())) : 0;
+    stats.ctlCalls = poller_->numCtlCalls();
+    stats.ctlAvoided = poller_->numCtlAvoided();
+    stats.pollWaitUs = pollWaitUs_.snapshot();
+    stats.activeChannels = activeChannelsHist_.snapshot();
+    stats.handleEventUs = handleEventUs_.snapshot();
+    stats.pendingFunctors = pendingFunctorsHist_.snapshot();
+    stats.doFunctorsUs = doFunctorsUs_.snapshot();
+    return stats;
+}
+
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
+TimingWheel* EventLoop::timingWheel()
+{
+    if (!timingWheel_)
+    {
+        timingWheel_.reset(new TimingWheel(this, kTimingWheelTickSeconds));
+    }
+    return timingWheel_.get();
+}
+
 // EventLoop的方法 ==调用==> Poller的方法
 void EventLoop::updateChannel(Channel* channel)
 {
@@ -176,18 +332,100 @@ bool EventLoop::hasChannel(Channel* channel)
 
 void EventLoop::doPendingFunctors()
 {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
+    // 先清掉唤醒标志再取队列：之后投递的回调会重新写eventfd，不会被漏掉。
+    // 用exchange和投递方的exchange同步，保证看得到它们之前push的节点
+    wakeupPending_.exchange(false, std::memory_order_acq_rel);
+
+    // 只执行进来时已经在队列里的回调，执行过程中新加的留到下一轮（queueInLoop会唤醒loop）。
+    // 高优先级的先全部执行；低优先级的最多执行预算个，剩下的留到下一轮，先让下一轮的IO事件得到处理
+    FunctorLane &high = lanes_[kHighPriority];
+    FunctorLane &low = lanes_[kLowPriority];
+    size_t executed = runFunctors(&high, high.size.load(std::memory_order_acquire));
+    size_t lowPending = low.size.load(std::memory_order_acquire);
+    size_t budget = lowPriorityBudget_.load(std::memory_order_relaxed);
+    size_t n = (budget > 0 && lowPending > budget) ? budget : lowPending;
+    executed += runFunctors(&low, n);
+    lowPriorityBacklog_ = n < lowPending;
+    pendingFunctorsHist_.record(executed);
 
+    // 本轮的收尾回调，排在所有的事件处理和pendingFunctors之后
+    std::vector<Functor> endFunctors;
+    endFunctors.swap(iterationEndFunctors_);
+    callingIterationEndFunctors_ = true;
+    for(const Functor &functor : endFunctors)
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_);
+        functor();
     }
+    callingIterationEndFunctors_ = false;
+
+    callingPendingFunctors_ = false;
+}
 
-    for(const Functor &functor : functors)
+size_t EventLoop::runFunctors(FunctorLane *lane, size_t n)
+{
+    size_t executed = 0;
+    for(; executed < n; ++executed)
     {
-        functor();      // 执行当前loop需要执行的回调操作 
+        MpscNode *node = lane->queue.pop();
+        if(node == nullptr)
+        {
+            break;      // 生产者还没把节点链接好，它push完之后会wakeup
+        }
+        lane->size.fetch_sub(1, std::memory_order_relaxed);
+        std::unique_ptr<FunctorNode> functor(static_cast<FunctorNode*>(node));
+        functor->functor();      // 执行当前loop需要执行的回调操作 
     }
+    return executed;
+}
 
-    callingPendingFunctors_ = false;
-}
\ No newline at end of file
+void EventLoop::runAtIterationEnd(Functor cb)
+{
+    iterationEndFunctors_.emplace_back(std::move(cb));
+    // 收尾回调里注册的回调要到下一轮才执行，唤醒一下，避免loop阻塞在poll上
+    if(callingIterationEndFunctors_)
+    {
+        wakeup();
+    }
+}
+
+void EventLoop::retryAtIterationEnd(Functor cb)
+{
+    iterationEndFunctors_.emplace_back(std::move(cb));
+}
+
+void EventLoop::addSweepCallback(SweepNode *node, SweepNode::Callback cb, void *arg)
+{
+    node->callback = cb;
+    node->arg = arg;
+    node->prev = sweepList_.prev;
+    node->next = &sweepList_;
+    sweepList_.prev->next = node;
+    sweepList_.prev = node;
+}
+
+void EventLoop::removeSweepCallback(SweepNode *node)
+{
+    if (node->linked())
+    {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = node->next = nullptr;
+    }
+}
+
+void EventLoop::doSweep()
+{
+    if (sweepList_.next == &sweepList_
+        || timeDifference(pollReturnTime_, lastSweepTime_) * 1000 < kSweepIntervalMs)
+    {
+        return;
+    }
+    lastSweepTime_ = pollReturnTime_;
+    for (SweepNode *node = sweepList_.next; node != &sweepList_; )
+    {
+        SweepNode *next = node->next;   // 回调里可能注销自己
+        node->callback(node->arg);
+        node = next;
+    }
+}
@@ -6,21 +6,39 @@
 #include <atomic>
 #include <thread>
 #include <memory>
-#include <mutex>
+#include <stdint.h>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "MpscQueue.h"
+#include "Task.h"
+#include "LoopStats.h"
+#include "SweepNode.h"
 
 class Channel;
 class Poller;
+class BufferSlab;
+class TimerQueue;
+class TimingWheel;
 
 
 // 事件循环类 （两大模块：Channel  Poller（epoll的抽象））
 class EventLoop : noncopyable
 {
 public:
-    using Functor = std::function<void()>;
+    // 只能移动的回调，常见的闭包不需要分配内存（见Task.h）
+    using Functor = Task;
+
+    // queueInLoop/runInLoop的优先级
+    enum Priority
+    {
+        kHighPriority,  // 每轮先执行，不受预算限制。用于很短、对延迟敏感的操作（新连接建立、定时器增删）
+        kLowPriority,   // 默认。每轮最多执行lowPriorityBudget个，剩下的留到下一轮，不会饿死IO事件
+        kNumPriorities
+    };
 
     EventLoop();
     ~EventLoop();
@@ -29,25 +47,105 @@ public:
     void quit();    // 退出事件循环
 
     Timestamp pollReturnTime() const { return pollReturnTime_; }
+    // 已经完成的事件循环轮数
+    uint64_t iteration() const { return iteration_.load(std::memory_order_relaxed); }
     
-    void runInLoop(Functor cb);     // 在当前loop中执行
-    void queueInLoop(Functor cb);   // 把cb放入队列中，等唤醒loop所在的线程，再执行cb
+    // 在当前loop中执行（在loop线程里调用时直接执行，和优先级无关）
+    void runInLoop(Functor cb, Priority priority = kLowPriority);
+    // 把cb放入对应优先级的队列中，等唤醒loop所在的线程，再执行cb。同一优先级的回调按投递顺序执行
+    void queueInLoop(Functor cb, Priority priority = kLowPriority);
+    // 队列中还没执行的回调个数
+    size_t queueSize() const { return pendingFunctorCount(); }
+
+    // 每轮最多执行的低优先级回调个数，0表示不限制，可以在任意线程调用
+    void setLowPriorityBudget(size_t budget) { lowPriorityBudget_.store(budget, std::memory_order_relaxed); }
+    size_t lowPriorityBudget() const { return lowPriorityBudget_.load(std::memory_order_relaxed); }
+    static const size_t kDefaultLowPriorityBudget = 1024;
     
-    void wakeup();                  // 唤醒loop所在的线程
+    void wakeup();                  // 唤醒loop所在的线程（已经有没处理的唤醒、或者loop醒着时不重复写eventfd）
+
+    // queueInLoop的调用次数，和实际写eventfd唤醒loop的次数
+    uint64_t numPosts() const { return numPosts_.load(std::memory_order_relaxed); }
+    uint64_t numWakeups() const { return numWakeups_.load(std::memory_order_relaxed); }
+
+    // 运行统计的快照（poll等待时间、每轮的活跃channel数和处理时间、回调个数和执行时间等），
+    // 可以在任意线程调用，不会打断loop
+    LoopStats stats() const;
+
+    /**
+     * 定时器，可以在任意线程调用，回调在loop线程上执行。
+     * runAt在time时刻执行，runAfter在delay秒之后执行，runEvery每隔interval秒执行一次
+     */
+    TimerId runAt(Timestamp time, TimerCallback cb);
+    TimerId runAfter(double delay, TimerCallback cb);
+    TimerId runEvery(double interval, TimerCallback cb);
+    // 取消定时器，可以在任意线程调用
+    void cancel(TimerId timerId);
+
+    // 本loop的时间轮（第一次用到时创建），用来管理大量连接的空闲超时，只能在loop线程调用
+    TimingWheel* timingWheel();
+
+    /**
+     * 在本轮循环的末尾（活跃channel和pendingFunctors都处理完之后）执行一次cb，只能在loop线程调用。
+     * 用来把一轮里多次的操作合并成一次，例如连接的合并发送。
+     * 在这些回调里再注册的回调留到下一轮执行，并且会唤醒loop，不会等到下一个无关的事件
+     */
+    void runAtIterationEnd(Functor cb);
+    /**
+     * 和runAtIterationEnd一样在一轮的末尾执行，但在收尾回调里登记时不唤醒loop，留到下一次因为别的事件醒来的那一轮。
+     * 适合"每轮都检查一次、直到条件满足"的场景（例如暂停读的连接等待输入缓冲区被消费），不会让loop空转
+     */
+    void retryAtIterationEnd(Functor cb);
 
     // EventLoop的方法 ===调用==》 Poller的方法
     void updateChannel(Channel* channel);
     void removeChannel(Channel* channel);
     bool hasChannel(Channel* channel);
 
+    /**
+     * 注册/注销一个周期性的清理回调（例如空闲连接的缓冲区回收），只能在loop线程调用。
+     * 所有清理回调每隔kSweepIntervalMs在一轮循环的末尾执行一次，回调里只能注销自己。
+     * node由调用者持有，注销之前不能销毁
+     */
+    void addSweepCallback(SweepNode *node, SweepNode::Callback cb, void *arg);
+    void removeSweepCallback(SweepNode *node);
+
+    /**
+     * 忙轮询：每次阻塞在poll之前，先用0超时的poll和检查回调队列空转budgetUs微秒，
+     * 这期间有事件或者投递就立即处理，省掉一次睡眠和eventfd唤醒；空转完还没有事件才阻塞等待。
+     * 空转期间投递方不会写eventfd。会占满一个CPU核，budgetUs为0时关闭（默认），可以在任意线程调用
+     */
+    void setBusyPoll(int budgetUs);
+    int busyPollBudget() const { return busyPollUs_.load(std::memory_order_relaxed); }
+
+    // 本loop上连接的缓冲区内存从这里分配（只在loop线程上无锁）
+    const std::shared_ptr<BufferSlab>& bufferSlab() const { return bufferSlab_; }
+
     // 判断EventLoop对象是否在自己的线程里
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 
 private: 
     void handleRead(); // wake up
     void doPendingFunctors(); // 执行回调
+    void doSweep();           // 到时间了就执行清理回调
+    // 开了忙轮询时先空转，返回poll的返回时间
+    Timestamp busyPoll(int timeoutMs);
 
     using ChannelList = std::vector<Channel*>;
+
+    // 一个优先级的回调队列
+    struct FunctorLane
+    {
+        MpscQueue queue;                // 任意线程无锁push，loop线程pop
+        std::atomic<size_t> size;       // queue中的回调个数
+    };
+    // 从lane中取出最多n个回调执行，返回执行的个数
+    size_t runFunctors(FunctorLane *lane, size_t n);
+    size_t pendingFunctorCount() const
+    {
+        return lanes_[kHighPriority].size.load(std::memory_order_acquire)
+             + lanes_[kLowPriority].size.load(std::memory_order_acquire);
+    }
     
     /* 原子变量，它能够确保对共享变量的操作在执行时不会
     被其他线程的操作干扰，从而避免竞态条件和死锁 */
@@ -57,17 +155,51 @@ private:
     const pid_t threadId_;          // 记录当前loop所在线程的id
     
     Timestamp pollReturnTime_;      // poller返回发生事件channels的时间点
+    std::atomic<uint64_t> iteration_;   // 循环轮数（只有loop线程写）
     std::unique_ptr<Poller> poller_;// 指向poller
+    std::unique_ptr<TimerQueue> timerQueue_;    // 定时器队列（timerfd注册在poller_上，要在poller_之后构造、之前析构）
+    std::unique_ptr<TimingWheel> timingWheel_;  // 由timerQueue_上的周期定时器推动
+    std::shared_ptr<BufferSlab> bufferSlab_;    // 缓冲区内存分配器（可能被还没析构的连接延长生命期）
     
     int wakeupFd_;  // 当mainLoop获取一个新用户的channel，通过轮询，选择一个subLoop并唤醒之
+    /**
+     * loop醒着（poll返回之后、doPendingFunctors取队列之前）或者已经写过eventfd还没处理时为true，
+     * 这期间的wakeup不用再写eventfd。doPendingFunctors取队列之前清掉，之后的投递会重新唤醒
+     */
+    std::atomic_bool wakeupPending_;
+    std::atomic<uint64_t> numPosts_;
+    std::atomic<uint64_t> numWakeups_;
+    std::atomic_int busyPollUs_;                // 忙轮询的空转时长，0表示不忙轮询
     std::unique_ptr<Channel> wakeupChannel_;    // 指向唤醒的channel，包含的是 wakeupfd
 
+    // 运行统计，只有loop线程写，stats()在任意线程读
+    Log2Histogram pollWaitUs_;
+    Log2Histogram activeChannelsHist_;
+    Log2Histogram handleEventUs_;
+    Log2Histogram pendingFunctorsHist_;
+    Log2Histogram doFunctorsUs_;
+    std::atomic<int64_t> busySince_;            // 这一轮poll返回的时间（微秒），阻塞在poll里时为0
+
     ChannelList activeChannels_;                // 活跃的Channel表
     Channel* currentActiveChannel_;             // 当前活跃的Channel
 
+    // 无锁队列的节点，回调跟着节点一起分配
+    struct FunctorNode : MpscNode
+    {
+        explicit FunctorNode(Functor cb) : functor(std::move(cb)) {}
+        Functor functor;
+    };
+
     std::atomic_bool callingPendingFunctors_;   // 标识当前loop是否有需要执行的回调操作
-    std::vector<Functor> pendingFunctors_;      // 存储loop需要执行的所有的回调操作
-    std::mutex mutex_;                          // 保护上面vector容器的线程安全
+    FunctorLane lanes_[kNumPriorities];         // 存储loop需要执行的所有的回调操作，按优先级分开
+    std::atomic<size_t> lowPriorityBudget_;
+    bool lowPriorityBacklog_;                   // 上一轮低优先级的回调没执行完，下一次poll不阻塞
+
+    std::vector<Functor> iterationEndFunctors_; // 本轮末尾执行的回调，只在loop线程访问
+    bool callingIterationEndFunctors_;
+
+    SweepNode sweepList_;                       // 周期性的清理回调，带头结点的双向循环链表
+    Timestamp lastSweepTime_;                   // 上一次执行清理回调的时间
 };
 
 
@@ -1,5 +1,6 @@
 #include "EventLoopThreadPool.h"
 #include "EventLoopThread.h"
+#include "EventLoop.h"
 
 #include <memory>
 
@@ -27,6 +28,12 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
         loops_.push_back(t->startLoop()); // 底层创建线程，绑定一个新的EventLoop，并返回该loop的地址
     }
 
+    for (const auto &setting : busyPollSettings_)
+    {
+        applyBusyPoll(setting.first, setting.second);
+    }
+    busyPollSettings_.clear();
+
     // 整个服务端只有一个线程，运行着baseloop
     if (numThreads_ == 0 && cb)
     {
@@ -34,6 +41,33 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     }
 }
 
+void EventLoopThreadPool::setBusyPoll(int budgetUs, int index)
+{
+    if (started_)
+    {
+        applyBusyPoll(budgetUs, index);
+    }
+    else
+    {
+        busyPollSettings_.emplace_back(budgetUs, index);
+    }
+}
+
+void EventLoopThreadPool::applyBusyPoll(int budgetUs, int index)
+{
+    if (index < 0)
+    {
+        for (EventLoop *loop : loops_)
+        {
+            loop->setBusyPoll(budgetUs);
+        }
+    }
+    else if (index < static_cast<int>(loops_.size()))
+    {
+        loops_[index]->setBusyPoll(budgetUs);
+    }
+}
+
 // 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop
 EventLoop* EventLoopThreadPool::getNextLoop()
 {
@@ -43,7 +77,7 @@ EventLoop* EventLoopThreadPool::getNextLoop()
     {
         loop = loops_[next_];
         ++next_;
-        if (next_ >= loops_.size())
+        if (next_ >= static_cast<int>(loops_.size()))
         {
             next_ = 0;
         }
@@ -19,6 +19,10 @@ public:
 
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
+    // 给第index个subloop开启busy-poll（见EventLoop::setBusyPoll），index为-1表示所有subloop。
+    // start之前设置的在subloop创建后生效，之后设置的立即生效。参数顺序和TcpServer::setBusyPoll一致
+    void setBusyPoll(int budgetUs, int index = -1);
+
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
     // 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop
@@ -29,6 +33,7 @@ public:
     bool started() const { return started_; }
     const std::string name() const { return name_; }
 private:
+    void applyBusyPoll(int budgetUs, int index);
 
     EventLoop *baseLoop_; // EventLoop loop;  (mainloop)
     std::string name_;
@@ -37,4 +42,5 @@ private:
     int next_;            // 轮询下标
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
+    std::vector<std::pair<int, int>> busyPollSettings_;    // (budgetUs, index)
 };
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "LoopStats.h"
+
+#include <stdio.h>
+
+const int Log2Histogram::kNumBuckets;
+
+Log2Histogram::Log2Histogram()
+    : sum_(0)
+    , max_(0)
+{
+    for (auto &bucket : buckets_)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+Log2Histogram::Snapshot Log2Histogram::snapshot() const
+{
+    Snapshot snap;
+    snap.count = 0;
+    for (int i = 0; i < kNumBuckets; ++i)
+    {
+        snap.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        snap.count += snap.buckets[i];
+    }
+    snap.sum = sum_.load(std::memory_order_relaxed);
+    snap.max = max_.load(std::memory_order_relaxed);
+    return snap;
+}
+
+uint64_t Log2Histogram::Snapshot::bucketLimit(int index)
+{
+    return index == 0 ? 0 : (1ULL << index) - 1;
+}
+
+uint64_t Log2Histogram::Snapshot::percentile(double p) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100 * count);
+    if (rank >= count)
+    {
+        rank = count - 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; ++i)
+    {
+        seen += buckets[i];
+        if (seen > rank)
+        {
+            uint64_t limit = bucketLimit(i);
+            return limit < max ? limit : max;   // 不会超过实际的最大值
+        }
+    }
+    return max;
+}
+
+namespace
+{
+void appendHistogram(std::string *out, const char *name, const Log2Histogram::Snapshot &h)
+{
+    char buf[256];
+    snprintf(buf, sizeof buf, " %s{avg=%.1f p50=%lu p99=%lu max=%lu}", name, h.mean(),
+             static_cast<unsigned long>(h.percentile(50)),
+             static_cast<unsigned long>(h.percentile(99)),
+             static_cast<unsigned long>(h.max));
+    out->append(buf);
+}
+}
+
+std::string LoopStats::toString() const
+{
+    char buf[256];
+    snprintf(buf, sizeof buf, "iterations=%lu posts=%lu wakeups=%lu queue=%zu busyUs=%ld ctlCalls=%lu ctlAvoided=%lu",
+             static_cast<unsigned long>(iterations), static_cast<unsigned long>(posts),
+             static_cast<unsigned long>(wakeups), queueSize, static_cast<long>(busyUs),
+             static_cast<unsigned long>(ctlCalls), static_cast<unsigned long>(ctlAvoided));
+    std::string out(buf);
+    appendHistogram(&out, "pollWaitUs", pollWaitUs);
+    appendHistogram(&out, "activeChannels", activeChannels);
+    appendHistogram(&out, "handleEventUs", handleEventUs);
+    appendHistogram(&out, "pendingFunctors", pendingFunctors);
+    appendHistogram(&out, "doFunctorsUs", doFunctorsUs);
+    return out;
+}
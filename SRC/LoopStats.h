@@ -0,0 +1,86 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+/**
+ * 以2为底的对数直方图：第0个桶记录0，第i个桶记录[2^(i-1), 2^i)，最后一个桶兼收更大的值。
+ * 只允许一个线程（loop线程）record，任意线程可以随时snapshot，不加锁。
+ * 各个桶是分别读出来的，快照和正在进行的record之间可能差一两个样本
+ */
+class Log2Histogram : noncopyable
+{
+public:
+    static const int kNumBuckets = 32;
+
+    struct Snapshot
+    {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t buckets[kNumBuckets];
+
+        double mean() const { return count == 0 ? 0.0 : static_cast<double>(sum) / count; }
+        // 估计的百分位（p取0~100），返回所在桶的上界，误差在2倍以内
+        uint64_t percentile(double p) const;
+        // 桶能记录的最大值
+        static uint64_t bucketLimit(int index);
+    };
+
+    Log2Histogram();
+
+    void record(uint64_t value)
+    {
+        int index = bucketIndex(value);
+        // 只有一个写者，不需要带锁的fetch_add
+        buckets_[index].store(buckets_[index].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if (value > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    Snapshot snapshot() const;
+
+private:
+    static int bucketIndex(uint64_t value)
+    {
+        if (value == 0)
+        {
+            return 0;
+        }
+        int index = 64 - __builtin_clzll(value);
+        return index < kNumBuckets ? index : kNumBuckets - 1;
+    }
+
+    std::atomic<uint64_t> buckets_[kNumBuckets];
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+/**
+ * 一个EventLoop的运行统计（EventLoop::stats()的返回值），时间的单位都是微秒。
+ * 用来比较各个subloop的负载是否均衡、发现卡住的loop
+ */
+struct LoopStats
+{
+    uint64_t iterations;        // 已经完成的循环轮数
+    uint64_t posts;             // queueInLoop的调用次数
+    uint64_t wakeups;           // 实际写eventfd唤醒loop的次数
+    size_t queueSize;           // 取快照时队列中还没执行的回调个数
+    int64_t busyUs;             // 当前这一轮已经处理了多久，loop阻塞在poll里时为0；很大说明loop卡住了
+    uint64_t ctlCalls;          // 修改内核中注册事件的系统调用次数（epoll_ctl）
+    uint64_t ctlAvoided;        // 因为合并或者没有变化而省掉的epoll_ctl次数
+
+    Log2Histogram::Snapshot pollWaitUs;         // 每轮在poll里等待的时间
+    Log2Histogram::Snapshot activeChannels;     // 每轮的活跃channel个数
+    Log2Histogram::Snapshot handleEventUs;      // 每轮处理活跃channel的总时间
+    Log2Histogram::Snapshot pendingFunctors;    // 每轮执行的pendingFunctors个数
+    Log2Histogram::Snapshot doFunctorsUs;       // 每轮在doPendingFunctors里的时间
+
+    std::string toString() const;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+
+// 侵入式队列的节点，使用者把它放在自己结构体的开头
+struct MpscNode
+{
+    std::atomic<MpscNode*> next;
+};
+
+/**
+ * 无锁的多生产者单消费者队列（Dmitry Vyukov的侵入式MPSC队列）。
+ * push可以在任意线程调用，只有一次原子exchange，不加锁；pop只能在消费者线程调用。
+ * 生产者exchange之后、链接next之前被打断时，pop会暂时返回nullptr（队列不是空的，稍后再取）
+ */
+class MpscQueue : noncopyable
+{
+public:
+    MpscQueue()
+        : head_(&stub_)
+        , tail_(&stub_)
+    {
+        stub_.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    void push(MpscNode *node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        MpscNode *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    MpscNode* pop()
+    {
+        MpscNode *tail = tail_;
+        MpscNode *next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_)
+        {
+            if (next == nullptr)
+            {
+                return nullptr;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr)
+        {
+            tail_ = next;
+            return tail;
+        }
+        if (tail != head_.load(std::memory_order_acquire))
+        {
+            return nullptr;     // 有生产者正在push
+        }
+        // tail是最后一个节点，先把stub挂到后面，才能把tail取出来
+        push(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next != nullptr)
+        {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<MpscNode*> head_;   // 生产者从这里push
+    char pad_[64];                  // 生产者和消费者访问的字段分开在不同的cache line
+    MpscNode *tail_;                // 消费者从这里pop
+    MpscNode stub_;
+};
@@ -0,0 +1,105 @@
+#include "PollPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+#include <errno.h>
+
+PollPoller::PollPoller(EventLoop *loop)
+    : Poller(loop)
+{
+}
+
+PollPoller::~PollPoller() = default;
+
+Timestamp PollPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_DEBUG("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels());
+
+    int numEvents = ::poll(pollfds_.data(), pollfds_.size(), timeoutMs);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    if(numEvents > 0)
+    {
+        LOG_DEBUG("%d events happend \n", numEvents);
+        fillActiveChannels(numEvents, activeChannels);
+    }
+    else if(numEvents == 0)
+    {
+        LOG_DEBUG("%s timeout! \n", __FUNCTION__);
+    }
+    else
+    {
+        if(saveErrno != EINTR)
+        {
+            errno = saveErrno;
+            LOG_ERROR("PollPoller::poll() err!");
+        }
+    }
+    return now;
+}
+
+void PollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels) const
+{
+    for(auto pfd = pollfds_.begin(); pfd != pollfds_.end() && numEvents > 0; ++pfd)
+    {
+        if(pfd->revents > 0)
+        {
+            --numEvents;
+            Channel *channel = findChannel(pfd->fd);
+            channel->set_revents(pfd->revents);
+            activeChannels->push_back(channel);
+        }
+    }
+}
+
+// index_小于0表示还不在pollfds_里，否则是它在pollfds_里的下标
+void PollPoller::updateChannel(Channel *channel)
+{
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n",
+         __FUNCTION__, channel->fd(), channel->events(), channel->index());
+
+    if(channel->index() < 0)     // 新加入的，放到数组末尾
+    {
+        struct pollfd pfd;
+        pfd.fd = channel->fd();
+        pfd.events = static_cast<short>(channel->events());
+        pfd.revents = 0;
+        pollfds_.push_back(pfd);
+        channel->set_index(static_cast<int>(pollfds_.size()) - 1);
+        addChannel(pfd.fd, channel);
+    }
+    else                         // 已经在数组里，按下标直接改
+    {
+        struct pollfd &pfd = pollfds_[channel->index()];
+        pfd.events = static_cast<short>(channel->events());
+        pfd.revents = 0;
+        // 对任何事件都不感兴趣时把fd取负，poll会忽略它（-fd-1是为了fd为0时也是负数）
+        pfd.fd = channel->isNoneEvent() ? -channel->fd() - 1 : channel->fd();
+    }
+}
+
+void PollPoller::removeChannel(Channel *channel)
+{
+    LOG_DEBUG("func=%s => fd=%d \n", __FUNCTION__, channel->fd());
+
+    eraseChannel(channel->fd());
+    int index = channel->index();
+    if(index >= 0)
+    {
+        // 把最后一项换到被删的位置上，再改一下被换过来的channel的下标
+        size_t last = pollfds_.size() - 1;
+        if(static_cast<size_t>(index) != last)
+        {
+            int movedFd = pollfds_[last].fd;
+            if(movedFd < 0)
+            {
+                movedFd = -movedFd - 1;
+            }
+            pollfds_[index] = pollfds_[last];
+            findChannel(movedFd)->set_index(index);
+        }
+        pollfds_.pop_back();
+    }
+    channel->set_index(-1);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <poll.h>
+
+class Channel;
+
+/**
+ * poll(2)实现的Poller，设置环境变量MUDUO_USE_POLL启用。
+ * 适合只监听少量fd的loop（例如只有acceptor和wakeupfd的baseLoop）：
+ * 修改感兴趣的事件只改数组里的一项，不需要像epoll_ctl那样每次都进内核。
+ *
+ * pollfds_是紧凑的数组，channel的index_就是它在数组里的下标：
+ * 更新直接按下标改，删除时把最后一项换过来，都是O(1)
+ */
+class PollPoller : public Poller
+{
+public:
+    PollPoller(EventLoop *loop);
+    ~PollPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;  // ::poll
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+private:
+    void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
+
+    using PollFdList = std::vector<struct pollfd>;
+    PollFdList pollfds_;
+};
@@ -4,7 +4,8 @@
 #include "Timestamp.h"
 
 #include <vector>
-#include <unordered_map>
+#include <atomic>
+#include <stdint.h>
 
 class Channel;
 class EventLoop;
@@ -27,13 +28,33 @@ public:
     // 判断参数channel是否在当前Poller当中
     bool hasChannel(Channel* channel) const;
 
+    // 修改内核中注册事件的系统调用次数（epoll_ctl），和因为合并或者没有变化而省掉的次数，可以在任意线程读
+    uint64_t numCtlCalls() const { return numCtlCalls_.load(std::memory_order_relaxed); }
+    uint64_t numCtlAvoided() const { return numCtlAvoided_.load(std::memory_order_relaxed); }
+
     // EventLoop可以通过该接口获取默认的IO复用的具体实现
     static Poller* newDefaultPoller(EventLoop* loop);
 protected:
-    // map（高效查找）=> key:sockfd  value:sockfd所属的channel通道类型
-    using ChannelMap = std::unordered_map<int, Channel*>;
-    ChannelMap channels_;
+    // fd是从小往上分配的整数，直接用fd做下标，不用哈希
+    Channel* findChannel(int fd) const
+    {
+        return static_cast<size_t>(fd) < channels_.size() ? channels_[fd] : nullptr;
+    }
+    void addChannel(int fd, Channel* channel);
+    void eraseChannel(int fd);
+    size_t numChannels() const { return numChannels_; }
+
+    // 只有loop线程写
+    void countCtlCall() { numCtlCalls_.store(numCtlCalls_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+    void countCtlAvoided() { numCtlAvoided_.store(numCtlAvoided_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
 
 private:
+    // key:sockfd（下标）  value:sockfd所属的channel通道类型，没有注册的fd是nullptr
+    using ChannelMap = std::vector<Channel*>;
+    ChannelMap channels_;
+    size_t numChannels_;
+    std::atomic<uint64_t> numCtlCalls_;
+    std::atomic<uint64_t> numCtlAvoided_;
+
     EventLoop* ownerLoop_;      // 定义Poller所属的事件循环EventLoop
 };
\ No newline at end of file
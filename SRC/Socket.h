@@ -25,6 +25,7 @@ public:
     void setReuseAddr(bool on);     // 地址复用
     void setReusePort(bool on);     // 端口复用
     void setKeepAlive(bool on);     // 设置心跳包
+    bool setZeroCopy(bool on);      // 允许send(MSG_ZEROCOPY)，内核不支持时返回false
 private:
     const int sockfd_;
 };
\ No newline at end of file
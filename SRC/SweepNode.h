@@ -0,0 +1,19 @@
+#pragma once
+
+/**
+ * EventLoop上周期性清理回调的节点，侵入式地嵌在使用者（例如TcpConnection）里。
+ * 注册、注销都是O(1)的链表操作，不分配内存，也没有需要回收的id
+ */
+struct SweepNode
+{
+    using Callback = void (*)(void *arg);
+
+    SweepNode() : prev(nullptr), next(nullptr), callback(nullptr), arg(nullptr) {}
+
+    bool linked() const { return prev != nullptr; }
+
+    SweepNode *prev;
+    SweepNode *next;
+    Callback callback;
+    void *arg;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+/**
+ * 只能移动的void()回调，作为EventLoop::Functor。
+ * 和std::function相比内联存储大得多（kInlineSize字节）：TcpConnection里常见的
+ * std::bind(&TcpConnection::xxx, shared_from_this(), std::string)一类的闭包都能放进去，
+ * 投递到其它loop时不用再为闭包分配内存。放不下（或者移动可能抛异常）的才分配到堆上。
+ * 不要求闭包可拷贝，所以可以直接把string、unique_ptr之类的数据move进去
+ */
+class Task
+{
+public:
+    static const size_t kInlineSize = 64;
+
+    Task() : ops_(nullptr) {}
+    Task(std::nullptr_t) : ops_(nullptr) {}
+
+    template <typename F,
+              typename = typename std::enable_if<
+                  !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F &&f)
+        : ops_(nullptr)
+    {
+        using Fn = typename std::decay<F>::type;
+        construct<Fn>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Fn>()>());
+    }
+
+    Task(Task &&rhs) : ops_(nullptr) { moveFrom(rhs); }
+
+    Task& operator=(Task &&rhs)
+    {
+        if (this != &rhs)
+        {
+            reset();
+            moveFrom(rhs);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void operator()() const { ops_->invoke(&storage_); }
+
+    // 闭包是否放在了内联存储里（不需要分配内存）
+    bool isInline() const { return ops_ != nullptr && ops_->isInline; }
+
+private:
+    using Storage = typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type;
+
+    // 每种闭包类型一张函数表
+    struct Ops
+    {
+        void (*invoke)(void *storage);
+        void (*move)(void *dst, void *src);     // 移动之后销毁src
+        void (*destroy)(void *storage);
+        bool isInline;
+    };
+
+    template <typename Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= kInlineSize
+            && alignof(Fn) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template <typename Fn>
+    struct InlineOps
+    {
+        static void invoke(void *s) { (*static_cast<Fn*>(s))(); }
+        static void move(void *dst, void *src)
+        {
+            ::new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        }
+        static void destroy(void *s) { static_cast<Fn*>(s)->~Fn(); }
+        static const Ops ops;
+    };
+
+    template <typename Fn>
+    struct HeapOps
+    {
+        static Fn*& ptr(void *s) { return *static_cast<Fn**>(s); }
+        static void invoke(void *s) { (*ptr(s))(); }
+        static void move(void *dst, void *src) { ::new (dst) Fn*(ptr(src)); }
+        static void destroy(void *s) { delete ptr(s); }
+        static const Ops ops;
+    };
+
+    template <typename Fn, typename F>
+    void construct(F &&f, std::true_type)
+    {
+        ::new (&storage_) Fn(std::forward<F>(f));
+        ops_ = &InlineOps<Fn>::ops;
+    }
+
+    template <typename Fn, typename F>
+    void construct(F &&f, std::false_type)
+    {
+        ::new (&storage_) Fn*(new Fn(std::forward<F>(f)));
+        ops_ = &HeapOps<Fn>::ops;
+    }
+
+    void moveFrom(Task &rhs)
+    {
+        if (rhs.ops_)
+        {
+            rhs.ops_->move(&storage_, &rhs.storage_);
+            ops_ = rhs.ops_;
+            rhs.ops_ = nullptr;
+        }
+    }
+
+    void reset()
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    mutable Storage storage_;   // 调用闭包不改变Task本身，和std::function一样operator()是const的
+    const Ops *ops_;
+};
+
+template <typename Fn>
+const Task::Ops Task::InlineOps<Fn>::ops = {
+    &Task::InlineOps<Fn>::invoke, &Task::InlineOps<Fn>::move, &Task::InlineOps<Fn>::destroy, true
+};
+
+template <typename Fn>
+const Task::Ops Task::HeapOps<Fn>::ops = {
+    &Task::HeapOps<Fn>::invoke, &Task::HeapOps<Fn>::move, &Task::HeapOps<Fn>::destroy, false
+};
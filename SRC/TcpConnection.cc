@@ -5,14 +5,28 @@
 #include "EventLoop.h"
 
 #include <functional>
+#include <algorithm>
 #include <errno.h>
 #include <sys/types.h>         
 #include <sys/socket.h>
 #include <strings.h>
 #include <netinet/tcp.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
 #include <string>
 
+const size_t TcpConnection::kDefaultZeroCopyThreshold;
+const size_t TcpConnection::kDefaultReadBudget;
+const size_t TcpConnection::kDefaultWriteBudget;
+
+// 零拷贝数据还没完成时，推迟的shutdownWrite和析构后的等待多久检查一次错误队列
+static const double kZeroCopyRetrySeconds = 0.1;
+
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
     if (loop == nullptr)
@@ -31,11 +45,38 @@ TcpConnection::TcpConnection(EventLoop *loop,
     , name_(nameArg)
     , state_(kConnecting)
     , reading_(true)
+    , inputPaused_(false)
+    , downstreamPauses_(0)
+    , inputHighWaterMark_(0)
+    , inputLowWaterMark_(0)
     , socket_(new Socket(sockfd))
     , channel_(new Channel(loop, sockfd))
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
     , highWaterMark_(64*1024*1024) // 64M
+    , upstreamPaused_(false)
+    , segmented_(false)
+    , autoCork_(false)
+    , corkFlushPending_(false)
+    , edgeTriggered_(false)
+    , readBudget_(kDefaultReadBudget)
+    , writeBudget_(kDefaultWriteBudget)
+    , readRequeued_(false)
+    , writeRequeued_(false)
+    , sendCalls_(0)
+    , writeSyscalls_(0)
+    , lastActiveIteration_(0)
+    , idleTimeout_(0)
+    , inputBuffer_(loop_->bufferSlab())
+    , outputBuffer_(loop_->bufferSlab())
+    , inputChain_(loop_->bufferSlab())
+    , outputChain_(loop_->bufferSlab())
+    , zeroCopy_(false)
+    , zeroCopyThreshold_(kDefaultZeroCopyThreshold)
+    , zeroCopyNextSeq_(0)
+    , zeroCopySends_(0)
+    , zeroCopyCompletions_(0)
+    , zeroCopyCopied_(0)
 {
     // 下面给channel设置相应的回调函数，poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
     channel_->setReadCallback(
@@ -60,6 +101,30 @@ TcpConnection::~TcpConnection()
 {
     LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", 
         name_.c_str(), channel_->fd(), (int)state_);
+    for (const PendingFile &file : pendingFiles_)
+    {
+        ::close(file.fd);
+    }
+    if (!zeroCopyPending_.empty())
+    {
+        // 内核还在引用这些数据（可能还会重传），不能跟着连接释放。dup一份socket让它在Socket关闭之后
+        // 继续存在，交给loop收齐完成通知；shutdown代替Socket的close通知对端连接结束
+        std::shared_ptr<ZeroCopyList> pending = std::make_shared<ZeroCopyList>();
+        pending->swap(zeroCopyPending_);
+        int fd = ::dup(channel_->fd());
+        if (fd < 0)
+        {
+            // 宁可泄漏也不能释放，内核可能还会从这块内存发送数据
+            LOG_ERROR("TcpConnection::dtor[%s] dup failed:%d, leak %zu zero-copy buffers \n",
+                name_.c_str(), errno, pending->size());
+            new std::shared_ptr<ZeroCopyList>(pending);
+        }
+        else
+        {
+            ::shutdown(fd, SHUT_RDWR);
+            loop_->runInLoop(std::bind(&TcpConnection::lingerZeroCopy, loop_, fd, pending));
+        }
+    }
 }
 
 void TcpConnection::send(const std::string &buf)
@@ -68,20 +133,164 @@ void TcpConnection::send(const std::string &buf)
     {
         if (loop_->isInLoopThread())
         {
-            sendInLoop(buf.c_str(), buf.size());
+            sendInLoop(buf.data(), buf.size());
+        }
+        else
+        {
+            // 调用者返回后buf可能就失效了，这里必须拷贝一份
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendStringInLoop,
+                shared_from_this(),
+                buf
+            ));
+        }
+    }
+}
+
+void TcpConnection::send(std::string &&buf)
+{
+    if (state_ == kConnected)
+    {
+        if (zeroCopy_ && buf.size() >= zeroCopyThreshold_)
+        {
+            // string挪到堆上，内核用完之前一直由holder持有
+            std::shared_ptr<std::string> holder(new std::string(std::move(buf)));
+            if (loop_->isInLoopThread())
+            {
+                sendZeroCopyInLoop(holder, holder->data(), holder->size());
+            }
+            else
+            {
+                loop_->runInLoop(std::bind(
+                    &TcpConnection::sendZeroCopyInLoop,
+                    shared_from_this(),
+                    holder,
+                    holder->data(),
+                    holder->size()
+                ));
+            }
+        }
+        else if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf.data(), buf.size());
         }
         else
         {
             loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()
+                &TcpConnection::sendStringInLoop,
+                shared_from_this(),
+                std::move(buf)
             ));
         }
     }
 }
 
+void TcpConnection::send(const void *data, size_t len)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(data, len);
+        }
+        else
+        {
+            send(std::string(static_cast<const char*>(data), len));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == kConnected)
+    {
+        if (zeroCopy_ && buf->readableBytes() >= zeroCopyThreshold_)
+        {
+            // holder用buf的slab构造，交换之后buf仍然从原来的slab分配
+            std::shared_ptr<Buffer> holder(new Buffer(buf->slab()));
+            holder->swap(*buf);
+            if (loop_->isInLoopThread())
+            {
+                sendZeroCopyInLoop(holder, holder->peek(), holder->readableBytes());
+            }
+            else
+            {
+                loop_->runInLoop(std::bind(
+                    &TcpConnection::sendZeroCopyInLoop,
+                    shared_from_this(),
+                    holder,
+                    holder->peek(),
+                    holder->readableBytes()
+                ));
+            }
+        }
+        else if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+        }
+        else
+        {
+            // 把buf的底层内存整个换出来，跟着回调交给loop线程。data用buf的slab构造，
+            // 交换之后buf仍然从原来的slab分配，换出去的内存在loop线程释放时走slab的跨线程归还
+            std::shared_ptr<Buffer> data(std::make_shared<Buffer>(buf->slab()));
+            data->swap(*buf);
+            TcpConnectionPtr self(shared_from_this());
+            loop_->runInLoop([self, data]() { self->sendInLoop(data->peek(), data->readableBytes()); });
+        }
+    }
+}
+
+void TcpConnection::sendv(const struct iovec *iov, int iovcnt)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendvInLoop(iov, iovcnt);
+        }
+        else
+        {
+            // iov指向的内存在调用返回后可能失效，拼成一份拷贝交给loop线程
+            size_t total = 0;
+            for (int i = 0; i < iovcnt; ++i)
+            {
+                total += iov[i].iov_len;
+            }
+            std::string message;
+            message.reserve(total);
+            for (int i = 0; i < iovcnt; ++i)
+            {
+                message.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+            }
+            send(std::move(message));
+        }
+    }
+}
+
+void TcpConnection::setEdgeTriggered(bool on, size_t readBudget, size_t writeBudget)
+{
+    edgeTriggered_ = on;
+    readBudget_ = readBudget;
+    writeBudget_ = writeBudget;
+    channel_->setEdgeTriggered(on);
+}
+
+void TcpConnection::setZeroCopy(bool on, size_t threshold)
+{
+    zeroCopyThreshold_ = threshold;
+    zeroCopy_ = socket_->setZeroCopy(on) && on;
+    if (on && !zeroCopy_)
+    {
+        LOG_ERROR("TcpConnection::setZeroCopy [%s] SO_ZEROCOPY not supported:%d \n", name_.c_str(), errno);
+    }
+}
+
+void TcpConnection::sendStringInLoop(const std::string &message)
+{
+    sendInLoop(message.data(), message.size());
+}
+
 /**
  * 发送数据  应用写的快， 而内核发送数据慢， 需要把待发送数据写入缓冲区， 而且设置了水位回调
  */ 
@@ -97,11 +306,14 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
         LOG_ERROR("disconnected, give up writing!");
         return;
     }
+    touch();
+    sendCalls_.fetch_add(1, std::memory_order_relaxed);
 
-    // 表示channel_第一次开始写数据，而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    // 表示channel_第一次开始写数据，而且缓冲区没有待发送数据（合并发送时留到本轮末尾一起写）
+    if (!autoCork_ && !channel_->isWriting() && outputBytes() == 0)
     {
         nwrote = ::write(channel_->fd(), data, len);
+        writeSyscalls_.fetch_add(1, std::memory_order_relaxed);
         if (nwrote >= 0)
         {
             remaining = len - nwrote;
@@ -132,148 +344,1049 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
     // 也就是调用TcpConnection::handleWrite方法，把发送缓冲区中的数据全部发送完成
     if (!faultError && remaining > 0) 
     {
-        // 目前发送缓冲区剩余的待发送数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining >= highWaterMark_
-            && oldLen < highWaterMark_
-            && highWaterMarkCallback_)
+        appendOutput(static_cast<const char*>(data) + nwrote, remaining);
+        scheduleWrite(); // 这里一定要注册channel的写事件（或者本轮末尾的flush），否则数据不会发出去
+    }
+}
+
+// 和sendInLoop一样，只是把write换成一次writev，再把每个片段没发出去的尾部依次追加到发送队列
+void TcpConnection::sendvInLoop(const struct iovec *iov, int iovcnt)
+{
+    size_t nwrote = 0;
+    bool faultError = false;
+
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    touch();
+    sendCalls_.fetch_add(1, std::memory_order_relaxed);
+
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        total += iov[i].iov_len;
+    }
+
+    if (!autoCork_ && !channel_->isWriting() && outputBytes() == 0)
+    {
+        ssize_t n = ::writev(channel_->fd(), iov, std::min(iovcnt, IOV_MAX));
+        writeSyscalls_.fetch_add(1, std::memory_order_relaxed);
+        if (n >= 0)
         {
-            loop_->queueInLoop(
-                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+remaining)
-            );
+            nwrote = n;
+            if (nwrote == total && writeCompleteCallback_)
+            {
+                loop_->queueInLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
         }
-        outputBuffer_.append((char*)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        else if (errno != EWOULDBLOCK)
         {
-            channel_->enableWriting(); // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
+            LOG_ERROR("TcpConnection::sendvInLoop");
+            if (errno == EPIPE || errno == ECONNRESET)
+            {
+                faultError = true;
+            }
         }
     }
-}
 
-// 关闭连接
-void TcpConnection::shutdown()
-{
-    if (state_ == kConnected)
+    if (!faultError && nwrote < total)
     {
-        setState(kDisconnecting);
-        loop_->runInLoop(
-            std::bind(&TcpConnection::shutdownInLoop, this)
-        );
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            size_t len = iov[i].iov_len;
+            if (nwrote >= len)
+            {
+                nwrote -= len;
+                continue;
+            }
+            appendOutput(static_cast<const char*>(iov[i].iov_base) + nwrote, len - nwrote);
+            nwrote = 0;
+        }
+        scheduleWrite();
     }
 }
 
-void TcpConnection::shutdownInLoop()
+// 和sendInLoop一样，只是直接发送时带上MSG_ZEROCOPY，并记下holder等待内核的完成通知。
+// 没发完的部分照常拷贝进发送缓冲区
+void TcpConnection::sendZeroCopyInLoop(const std::shared_ptr<void> &holder, const char *data, size_t len)
 {
-    if (!channel_->isWriting()) // 说明outputBuffer中的数据已经全部发送完成
+    ssize_t nwrote = 0;
+    size_t remaining = len;
+    bool faultError = false;
+
+    if (state_ == kDisconnected)
     {
-        socket_->shutdownWrite(); // 关闭写端
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    touch();
+    sendCalls_.fetch_add(1, std::memory_order_relaxed);
+
+    // 零拷贝的都是大块数据，不参与合并；前面有合并中的数据时outputBytes()不为0，照样排队
+    if (!channel_->isWriting() && outputBytes() == 0)
+    {
+        nwrote = ::send(channel_->fd(), data, len, MSG_ZEROCOPY);
+        writeSyscalls_.fetch_add(1, std::memory_order_relaxed);
+        if (nwrote < 0 && errno == ENOBUFS)   // 超过了locked memory限制，退回普通的拷贝发送
+        {
+            nwrote = ::write(channel_->fd(), data, len);
+            writeSyscalls_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (nwrote >= 0)
+        {
+            ZeroCopyBuffer pending = { zeroCopyNextSeq_++, holder };
+            zeroCopyPending_.push_back(std::move(pending));
+            zeroCopySends_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (nwrote >= 0)
+        {
+            remaining = len - nwrote;
+            if (remaining == 0 && writeCompleteCallback_)
+            {
+                loop_->queueInLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
+        }
+        else
+        {
+            nwrote = 0;
+            if (errno != EWOULDBLOCK)
+            {
+                LOG_ERROR("TcpConnection::sendZeroCopyInLoop");
+                if (errno == EPIPE || errno == ECONNRESET)
+                {
+                    faultError = true;
+                }
+            }
+        }
+    }
+
+    if (!faultError && remaining > 0)
+    {
+        appendOutput(data + nwrote, remaining);
+        scheduleWrite();
     }
 }
 
-// 连接建立
-void TcpConnection::connectEstablished()
+bool TcpConnection::handleZeroCopyCompletions()
 {
-    setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading(); // 向poller注册channel的epollin事件
-
-    // 新连接建立，执行回调
-    connectionCallback_(shared_from_this());
+    uint64_t completions = 0;
+    uint64_t copied = 0;
+    bool gotNotification = reapZeroCopyCompletions(channel_->fd(), &zeroCopyPending_, &completions, &copied);
+    zeroCopyCompletions_.fetch_add(completions, std::memory_order_relaxed);
+    zeroCopyCopied_.fetch_add(copied, std::memory_order_relaxed);
+    return gotNotification;
 }
 
-// 连接销毁
-void TcpConnection::connectDestroyed()
+bool TcpConnection::reapZeroCopyCompletions(int fd, ZeroCopyList *pending, uint64_t *completions, uint64_t *copied)
 {
-    if (state_ == kConnected)
+    bool gotNotification = false;
+    while (true)
     {
-        setState(kDisconnected);
-        channel_->disableAll(); // 把channel的所有感兴趣的事件，从poller中del掉
-        connectionCallback_(shared_from_this());
+        char control[128];
+        struct msghdr msg;
+        bzero(&msg, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+        {
+            break;  // EAGAIN：错误队列已经取空
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+            {
+                continue;
+            }
+            const struct sock_extended_err *serr =
+                reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+
+            // 序号在[ee_info, ee_data]之间的发送都完成了，TCP上的通知是按顺序到达的
+            gotNotification = true;
+            const uint32_t count = serr->ee_data - serr->ee_info + 1;
+            *completions += count;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                *copied += count;
+            }
+            while (!pending->empty()
+                && static_cast<int32_t>(pending->front().seq - serr->ee_data) <= 0)
+            {
+                pending->pop_front();
+            }
+        }
     }
-    channel_->remove(); // 把channel从poller中删除掉
+    return gotNotification;
 }
 
-void TcpConnection::handleRead(Timestamp receiveTime)
+void TcpConnection::lingerZeroCopy(EventLoop *loop, int fd, const std::shared_ptr<ZeroCopyList> &pending)
 {
-    int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-    if (n > 0)
-    {
-        // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
-    }
-    else if (n == 0)
+    uint64_t completions = 0;
+    uint64_t copied = 0;
+    reapZeroCopyCompletions(fd, pending.get(), &completions, &copied);
+    if (pending->empty())
     {
-        handleClose();
+        ::close(fd);
+        return;
     }
-    else
+    loop->runAfter(kZeroCopyRetrySeconds, std::bind(&TcpConnection::lingerZeroCopy, loop, fd, pending));
+}
+
+void TcpConnection::send(ChainBuffer *buf)
+{
+    if (state_ == kConnected)
     {
-        errno = savedErrno;
-        LOG_ERROR("TcpConnection::handleRead");
-        handleError();
+        if (loop_->isInLoopThread())
+        {
+            sendChainInLoop(buf);
+        }
+        else
+        {
+            // 块的引用转移到一个新的ChainBuffer中，跟着回调一起交给loop线程
+            std::shared_ptr<ChainBuffer> chain(new ChainBuffer);
+            chain->swap(*buf);
+            TcpConnectionPtr self(shared_from_this());
+            loop_->runInLoop([self, chain]() { self->sendChainInLoop(chain.get()); });
+        }
     }
 }
 
-void TcpConnection::handleWrite()
+// 和sendInLoop流程一样，只是直接writev链上的块，剩余的块挂到outputChain_上，全程不拷贝数据
+void TcpConnection::sendChainInLoop(ChainBuffer *buf)
 {
-    if (channel_->isWriting())
+    bool faultError = false;
+
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    touch();
+    sendCalls_.fetch_add(1, std::memory_order_relaxed);
+
+    if (!autoCork_ && !channel_->isWriting() && outputBytes() == 0)
     {
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if (n > 0)
+        ssize_t nwrote = buf->writeFd(channel_->fd(), &savedErrno);
+        writeSyscalls_.fetch_add(1, std::memory_order_relaxed);
+        if (nwrote >= 0)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            buf->retrieve(nwrote);
+            if (buf->readableBytes() == 0 && writeCompleteCallback_)
             {
-                channel_->disableWriting();
-                if (writeCompleteCallback_)
-                {
-                    // 唤醒loop_对应的thread线程，执行回调
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
-                    );
-                }
-                if (state_ == kDisconnecting)
-                {
-                    shutdownInLoop();
-                }
+                loop_->queueInLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
             }
         }
-        else
+        else if (savedErrno != EWOULDBLOCK)
         {
-            LOG_ERROR("TcpConnection::handleWrite");
+            LOG_ERROR("TcpConnection::sendChainInLoop");
+            if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+            {
+                faultError = true;
+            }
         }
     }
-    else
+
+    if (!faultError && buf->readableBytes() > 0)
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
+        appendOutput(buf);
+        scheduleWrite();
     }
 }
 
-// poller => channel::closeCallback => TcpConnection::handleClose
-void TcpConnection::handleClose()
+size_t TcpConnection::outputBytes() const
 {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
-    setState(kDisconnected);
-    channel_->disableAll();
-
-    TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr); // 执行连接关闭的回调
-    closeCallback_(connPtr); // 关闭连接的回调  执行的是TcpServer::removeConnection回调方法
+    size_t n = outputBuffer_.readableBytes() + outputChain_.readableBytes();
+    for (const PendingFile &file : pendingFiles_)
+    {
+        n += file.remaining + file.trailer.readableBytes();
+    }
+    return n;
 }
 
-void TcpConnection::handleError()
+// 目前发送缓冲区剩余的待发送数据的长度加上len超过高水位时，回调highWaterMarkCallback_
+void TcpConnection::checkHighWaterMark(size_t len)
 {
-    int optval;
-    socklen_t optlen = sizeof optval;
-    int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    size_t oldLen = outputBytes();
+    if (oldLen + len >= highWaterMark_
+        && oldLen < highWaterMark_
+        && highWaterMarkCallback_)
     {
-        err = errno;
+        loop_->queueInLoop(
+            std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+len)
+        );
+    }
+    if (oldLen + len >= highWaterMark_ && !upstreamPaused_)
+    {
+        TcpConnectionPtr upstream = upstream_.lock();
+        if (upstream)
+        {
+            upstreamPaused_ = true;
+            upstream->pauseByDownstream(true);
+        }
+    }
+}
+
+void TcpConnection::resumeUpstream(bool force)
+{
+    if (upstreamPaused_ && (force || outputBytes() < highWaterMark_ / 2))
+    {
+        upstreamPaused_ = false;
+        TcpConnectionPtr upstream = upstream_.lock();
+        if (upstream)
+        {
+            upstream->pauseByDownstream(false);
+        }
+    }
+}
+
+// 下游限流的暂停单独计数（一个上游可能被几个下游暂停），不改用户的reading_
+void TcpConnection::pauseByDownstream(bool pause)
+{
+    loop_->runInLoop(std::bind(&TcpConnection::pauseByDownstreamInLoop, shared_from_this(), pause));
+}
+
+void TcpConnection::pauseByDownstreamInLoop(bool pause)
+{
+    if (pause)
+    {
+        ++downstreamPauses_;
+    }
+    else if (downstreamPauses_ > 0)
+    {
+        --downstreamPauses_;
+    }
+    updateReading();
+}
+
+void TcpConnection::appendOutput(const char* data, size_t len)
+{
+    checkHighWaterMark(len);
+    // 只能往发送队列的最后面追加，保证发送顺序
+    if (!pendingFiles_.empty())
+    {
+        pendingFiles_.back().trailer.append(data, len);
+    }
+    else if (segmented_ || outputChain_.readableBytes() > 0)
+    {
+        outputChain_.append(data, len);
+    }
+    else
+    {
+        outputBuffer_.append(data, len);
+    }
+}
+
+void TcpConnection::appendOutput(ChainBuffer *buf)
+{
+    checkHighWaterMark(buf->readableBytes());
+    if (!pendingFiles_.empty())
+    {
+        pendingFiles_.back().trailer.appendAndClear(buf);
+    }
+    else
+    {
+        outputChain_.appendAndClear(buf);
+    }
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t length)
+{
+    if (state_ == kConnected)
+    {
+        int dupfd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (dupfd < 0)
+        {
+            LOG_ERROR("TcpConnection::sendFile dup fd=%d error:%d \n", fd, errno);
+            return;
+        }
+        if (loop_->isInLoopThread())
+        {
+            sendFileInLoop(dupfd, offset, length);
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(
+                &TcpConnection::sendFileInLoop,
+                shared_from_this(),
+                dupfd,
+                offset,
+                length
+            ));
+        }
+    }
+}
+
+// 和sendInLoop流程一样：前面没有排队的数据时直接sendfile，剩下的部分排进文件队列，等epollout再发
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t length)
+{
+    bool faultError = false;
+
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        ::close(fd);
+        return;
+    }
+    touch();
+    sendCalls_.fetch_add(1, std::memory_order_relaxed);
+
+    if (!channel_->isWriting() && outputBytes() == 0)
+    {
+        ssize_t nwrote = ::sendfile(channel_->fd(), fd, &offset, length);
+        writeSyscalls_.fetch_add(1, std::memory_order_relaxed);
+        if (nwrote >= 0)
+        {
+            length -= nwrote;
+            if (length == 0 && writeCompleteCallback_)
+            {
+                loop_->queueInLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
+        }
+        else if (errno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::sendFileInLoop fd=%d error:%d \n", fd, errno);
+            faultError = true;  // 连接出错，或者fd不支持sendfile
+        }
+    }
+
+    if (faultError)
+    {
+        // 文件内容没发出去，后面的数据不能接着发，否则对端按长度解析会错位
+        ::close(fd);
+        handleError();
+        forceClose();
+        return;
+    }
+
+    if (length > 0)
+    {
+        checkHighWaterMark(length);
+        PendingFile file = { fd, offset, length, ChainBuffer(loop_->bufferSlab()) };
+        pendingFiles_.push_back(std::move(file));
+        scheduleWrite();
+    }
+    else
+    {
+        ::close(fd);
+    }
+}
+
+ssize_t TcpConnection::sendPendingFile(int *saveErrno)
+{
+    PendingFile &file = pendingFiles_.front();
+    ssize_t n = ::sendfile(channel_->fd(), file.fd, &file.offset, file.remaining);
+    if (n > 0)
+    {
+        file.remaining -= n;
+        if (file.remaining == 0)
+        {
+            ::close(file.fd);
+            outputChain_.appendAndClear(&file.trailer);
+            pendingFiles_.pop_front();
+        }
+        return n;
+    }
+
+    if (n < 0)
+    {
+        *saveErrno = errno;
+        if (*saveErrno == EWOULDBLOCK || *saveErrno == EINTR)
+        {
+            return n;
+        }
+        LOG_ERROR("TcpConnection::sendPendingFile fd=%d error:%d \n", file.fd, *saveErrno);
+    }
+    else
+    {
+        LOG_ERROR("TcpConnection::sendPendingFile fd=%d reached EOF early, %zu bytes missing \n",
+                  file.fd, file.remaining);
+        *saveErrno = EIO;
+    }
+    // 文件发不完了：不能跳过它接着发trailer，否则对端收到的是截断的文件加上后面消息的数据，
+    // 按长度分帧的协议会错位。停止发送，关闭连接（文件在析构时关闭）
+    handleError();
+    forceClose();
+    return -1;
+}
+
+// 关闭连接
+void TcpConnection::shutdown()
+{
+    if (state_ == kConnected)
+    {
+        setState(kDisconnecting);
+        loop_->runInLoop(
+            std::bind(&TcpConnection::shutdownInLoop, this)
+        );
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this())
+        );
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();  // 和对端关闭走同样的流程
+    }
+}
+
+void TcpConnection::onIdleTimeout()
+{
+    LOG_INFO("TcpConnection::onIdleTimeout [%s] idle for %.1fs, force close \n", name_.c_str(), idleTimeout_);
+    forceClose();
+}
+
+void TcpConnection::shutdownInLoop()
+{
+    if (!channel_->isWriting() && outputBytes() == 0) // 说明发送队列中的数据已经全部发送完成（包括还没flush的合并数据）
+    {
+        // 零拷贝的数据内核还在引用时先不关闭写端：对端读到EOF就会关闭连接，连接析构时数据还没完成。
+        // 完成通知一般随EPOLLERR到达（handleError会再调用这里），读被停掉时channel可能不在epoll上，所以也定时检查
+        if (!zeroCopyPending_.empty())
+        {
+            handleZeroCopyCompletions();
+        }
+        if (!zeroCopyPending_.empty())
+        {
+            std::weak_ptr<TcpConnection> weak(shared_from_this());
+            loop_->runAfter(kZeroCopyRetrySeconds, [weak]() {
+                TcpConnectionPtr conn = weak.lock();
+                if (conn && conn->state_ == kDisconnecting)
+                {
+                    conn->shutdownInLoop();
+                }
+            });
+            return;
+        }
+        socket_->shutdownWrite(); // 关闭写端
+    }
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    reading_ = true;
+    updateReading();
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    reading_ = false;
+    updateReading();
+}
+
+void TcpConnection::updateReading()
+{
+    if (state_ != kConnected && state_ != kDisconnecting)
+    {
+        return;     // 还没有注册到poller，或者已经关闭了
+    }
+    bool want = reading_ && !inputPaused_ && downstreamPauses_ == 0;
+    if (want && !channel_->isReading())
+    {
+        channel_->enableReading();
+    }
+    else if (!want && channel_->isReading())
+    {
+        channel_->disableReading();
+    }
+}
+
+size_t TcpConnection::inputBytes() const
+{
+    return inputBuffer_.readableBytes() + inputChain_.readableBytes();
+}
+
+// 输入缓冲区只会在loop线程的某个回调里被消费，所以每轮末尾检查一次就够了。
+// 还没降下来就登记到下一轮，retryAtIterationEnd不会因此唤醒loop
+void TcpConnection::checkInputResume()
+{
+    if (!inputPaused_ || state_ == kDisconnected)
+    {
+        return;
+    }
+    if (inputBytes() <= inputLowWaterMark_)
+    {
+        inputPaused_ = false;
+        updateReading();
+    }
+    else
+    {
+        loop_->retryAtIterationEnd(std::bind(&TcpConnection::checkInputResume, shared_from_this()));
+    }
+}
+
+void TcpConnection::setUpstream(const TcpConnectionPtr &upstream)
+{
+    loop_->runInLoop(std::bind(&TcpConnection::setUpstreamInLoop, shared_from_this(), upstream));
+}
+
+void TcpConnection::setUpstreamInLoop(const TcpConnectionPtr &upstream)
+{
+    resumeUpstream(true);   // 换上游之前先放开旧的
+    upstream_ = upstream;
+    checkHighWaterMark(0);  // 发送队列已经在高水位之上时立即暂停新的上游
+}
+
+// 连接建立
+void TcpConnection::connectEstablished()
+{
+    setState(kConnected);
+    channel_->tie(shared_from_this());
+    updateReading(); // 向poller注册channel的epollin事件（之前调用过stopRead就先不注册）
+
+    touch();
+    if (idleTimeout_ > 0)
+    {
+        // 节点嵌在连接里，connectDestroyed时摘下来，所以回调里可以直接用this
+        loop_->timingWheel()->add(&idleNode_, idleTimeout_,
+                                  std::bind(&TcpConnection::onIdleTimeout, this));
+    }
+    if (reclaimPolicy_.idleIterations > 0 || reclaimPolicy_.idleMs > 0)
+    {
+        loop_->addSweepCallback(&sweepNode_, &TcpConnection::sweepCallback, this);
+    }
+
+    // 新连接建立，执行回调
+    connectionCallback_(shared_from_this());
+}
+
+// 连接销毁
+void TcpConnection::connectDestroyed()
+{
+    if (state_ == kConnected)
+    {
+        setState(kDisconnected);
+        channel_->disableAll(); // 把channel的所有感兴趣的事件，从poller中del掉
+        connectionCallback_(shared_from_this());
+    }
+    loop_->removeSweepCallback(&sweepNode_);
+    resumeUpstream(true);   // 本连接不会再发送了，不能让上游一直停着
+    if (idleNode_.linked())
+    {
+        loop_->timingWheel()->remove(&idleNode_);
+    }
+    channel_->remove(); // 把channel从poller中删除掉
+}
+
+void TcpConnection::handleRead(Timestamp receiveTime)
+{
+    touch();
+    if (idleNode_.linked())
+    {
+        loop_->timingWheel()->refresh(&idleNode_);
+    }
+    if (edgeTriggered_)
+    {
+        handleReadEdgeTriggered(receiveTime);
+        return;
+    }
+    int savedErrno = 0;
+    ssize_t n = readSocket(receiveTime, &savedErrno);
+    if (n == 0)
+    {
+        handleClose();
+    }
+    else if (n < 0)
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleRead");
+        handleError();
+    }
+}
+
+ssize_t TcpConnection::readSocket(Timestamp receiveTime, int *savedErrno)
+{
+    ssize_t n = segmented_ ? inputChain_.readFd(channel_->fd(), savedErrno)
+                           : inputBuffer_.readFd(channel_->fd(), savedErrno);
+    if (n > 0)
+    {
+        // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
+        if (!segmented_)
+        {
+            messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        }
+        else if (chainMessageCallback_)
+        {
+            chainMessageCallback_(shared_from_this(), &inputChain_, receiveTime);
+        }
+        else
+        {
+            inputChain_.appendTo(&inputBuffer_);
+            inputChain_.retrieveAll();
+            messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        }
+
+        if (reclaimPolicy_.reclaimOnDrain
+            && inputBuffer_.readableBytes() == 0
+            && inputBuffer_.capacity() > reclaimPolicy_.keepBytes)
+        {
+            size_t n = inputBuffer_.shrink(0);
+            if (reclaimCounter_) reclaimCounter_->fetch_add(n, std::memory_order_relaxed);
+        }
+
+        // 上层消费不过来，先停止读，让数据积压在内核里（对端的发送窗口会随之缩小）
+        if (inputHighWaterMark_ > 0 && !inputPaused_ && inputBytes() >= inputHighWaterMark_)
+        {
+            inputPaused_ = true;
+            updateReading();
+            loop_->runAtIterationEnd(std::bind(&TcpConnection::checkInputResume, shared_from_this()));
+        }
+    }
+    return n;
+}
+
+void TcpConnection::handleReadEdgeTriggered(Timestamp receiveTime)
+{
+    size_t bytes = 0;
+    while (true)
+    {
+        int savedErrno = 0;
+        ssize_t n = readSocket(receiveTime, &savedErrno);
+        if (n > 0)
+        {
+            bytes += n;
+            if (!channel_->isReading())
+            {
+                return;     // 回调里暂停了读（或者达到了输入高水位），恢复时重新注册EPOLLIN会再通知
+            }
+            if (bytes >= readBudget_)
+            {
+                if (!readRequeued_)
+                {
+                    readRequeued_ = true;
+                    loop_->queueInLoop(std::bind(&TcpConnection::continueRead, shared_from_this()));
+                }
+                return;
+            }
+        }
+        else if (n == 0)
+        {
+            handleClose();
+            return;
+        }
+        else if (savedErrno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            if (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+            {
+                errno = savedErrno;
+                LOG_ERROR("TcpConnection::handleRead");
+                handleError();
+            }
+            return;     // 读空了，等下一次EPOLLIN
+        }
+    }
+}
+
+void TcpConnection::continueRead()
+{
+    readRequeued_ = false;
+    if ((state_ == kConnected || state_ == kDisconnecting) && channel_->isReading())
+    {
+        handleRead(loop_->pollReturnTime());
+    }
+}
+
+void TcpConnection::handleWrite()
+{
+    if (channel_->isWriting())
+    {
+        touch();
+        if (idleNode_.linked())
+        {
+            loop_->timingWheel()->refresh(&idleNode_);
+        }
+        if (edgeTriggered_)
+        {
+            handleWriteEdgeTriggered();
+            return;
+        }
+        int savedErrno = 0;
+        ssize_t n = writeOutput(&savedErrno);
+        if (n >= 0)
+        {
+            if (outputBytes() == 0)
+            {
+                outputDrained();
+            }
+        }
+        else
+        {
+            LOG_ERROR("TcpConnection::handleWrite");
+        }
+    }
+    else
+    {
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
+    }
+}
+
+void TcpConnection::handleWriteEdgeTriggered()
+{
+    size_t bytes = 0;
+    while (true)
+    {
+        int savedErrno = 0;
+        ssize_t n = writeOutput(&savedErrno);
+        if (outputBytes() == 0)
+        {
+            outputDrained();
+            return;
+        }
+        if (n > 0)
+        {
+            bytes += n;
+            if (bytes >= writeBudget_)
+            {
+                if (!writeRequeued_)
+                {
+                    writeRequeued_ = true;
+                    loop_->queueInLoop(std::bind(&TcpConnection::continueWrite, shared_from_this()));
+                }
+                return;
+            }
+        }
+        else if (n < 0 && savedErrno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            if (n < 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+            {
+                LOG_ERROR("TcpConnection::handleWrite");
+            }
+            return;     // 发送缓冲区满了，等下一次EPOLLOUT
+        }
+    }
+}
+
+void TcpConnection::continueWrite()
+{
+    writeRequeued_ = false;
+    if (state_ != kDisconnected && channel_->isWriting())
+    {
+        handleWrite();
+    }
+}
+
+ssize_t TcpConnection::writeOutput(int *saveErrno)
+{
+    ssize_t n = 0;
+    if (outputBuffer_.readableBytes() > 0) // 先发outputBuffer_，再发排在它后面的outputChain_
+    {
+        n = outputBuffer_.writeFd(channel_->fd(), saveErrno);
+        if (n > 0) outputBuffer_.retrieve(n);
+    }
+    else if (outputChain_.readableBytes() > 0)
+    {
+        n = outputChain_.writeFd(channel_->fd(), saveErrno);
+        if (n > 0) outputChain_.retrieve(n);
+    }
+    else if (!pendingFiles_.empty())
+    {
+        n = sendPendingFile(saveErrno);
+    }
+    else
+    {
+        return 0;
+    }
+    writeSyscalls_.fetch_add(1, std::memory_order_relaxed);
+    if (n > 0)
+    {
+        resumeUpstream(false);
+    }
+    return n;
+}
+
+void TcpConnection::outputDrained()
+{
+    if (channel_->isWriting())
+    {
+        channel_->disableWriting();
+    }
+    if (reclaimPolicy_.reclaimOnDrain
+        && outputBuffer_.capacity() > reclaimPolicy_.keepBytes)
+    {
+        size_t n = outputBuffer_.shrink(0);
+        if (reclaimCounter_) reclaimCounter_->fetch_add(n, std::memory_order_relaxed);
+    }
+    if (writeCompleteCallback_)
+    {
+        // 唤醒loop_对应的thread线程，执行回调
+        loop_->queueInLoop(
+            std::bind(writeCompleteCallback_, shared_from_this())
+        );
+    }
+    if (state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+void TcpConnection::scheduleWrite()
+{
+    if (channel_->isWriting())
+    {
+        return;     // 已经在等epollout，handleWrite会接着发
+    }
+    if (!autoCork_)
+    {
+        channel_->enableWriting();
+    }
+    else if (!corkFlushPending_)
+    {
+        corkFlushPending_ = true;
+        loop_->runAtIterationEnd(std::bind(&TcpConnection::flushCorked, shared_from_this()));
+    }
+}
+
+// 一轮循环里合并下来的数据一次write/writev发出去，没发完的部分注册epollout由handleWrite继续
+void TcpConnection::flushCorked()
+{
+    corkFlushPending_ = false;
+    if (state_ == kDisconnected || channel_->isWriting() || outputBytes() == 0)
+    {
+        return;
+    }
+
+    int savedErrno = 0;
+    ssize_t n = writeOutput(&savedErrno);
+    if (n < 0 && savedErrno != EWOULDBLOCK)
+    {
+        LOG_ERROR("TcpConnection::flushCorked");
+        if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+        {
+            return;
+        }
+    }
+
+    if (outputBytes() == 0)
+    {
+        outputDrained();
+    }
+    else
+    {
+        channel_->enableWriting();
+    }
+}
+
+// poller => channel::closeCallback => TcpConnection::handleClose
+void TcpConnection::handleClose()
+{
+    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
+    setState(kDisconnected);
+    channel_->disableAll();
+
+    TcpConnectionPtr connPtr(shared_from_this());
+    connectionCallback_(connPtr); // 执行连接关闭的回调
+    closeCallback_(connPtr); // 关闭连接的回调  执行的是TcpServer::removeConnection回调方法
+}
+
+void TcpConnection::handleError()
+{
+    // 零拷贝发送的完成通知也是以EPOLLERR的形式报上来的
+    bool zeroCopyNotified = zeroCopy_ && handleZeroCopyCompletions();
+    if (zeroCopyNotified && state_ == kDisconnecting && zeroCopyPending_.empty())
+    {
+        shutdownInLoop();   // 推迟的shutdownWrite
+    }
+
+    int optval;
+    socklen_t optlen = sizeof optval;
+    int err = 0;
+    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        err = errno;
     }
     else
     {
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
-}
\ No newline at end of file
+    if (err != 0 || !zeroCopyNotified)
+    {
+        LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
+    }
+}
+void TcpConnection::touch()
+{
+    lastActiveIteration_ = loop_->iteration();
+    lastActiveTime_ = loop_->pollReturnTime();
+}
+
+void TcpConnection::reclaimIfIdle()
+{
+    bool idle = (reclaimPolicy_.idleIterations > 0
+                    && loop_->iteration() - lastActiveIteration_ >= reclaimPolicy_.idleIterations)
+             || (reclaimPolicy_.idleMs > 0
+                    && timeDifference(loop_->pollReturnTime(), lastActiveTime_) * 1000 >= reclaimPolicy_.idleMs);
+    if (idle)
+    {
+        reclaimBuffers();
+    }
+}
+
+// 空的缓冲区整块释放，还有数据的缓冲区收缩到刚好放下数据（ChainBuffer的块在数据取走后就已经释放了）
+size_t TcpConnection::reclaimBuffers()
+{
+    size_t n = 0;
+    if (inputBuffer_.capacity() > reclaimPolicy_.keepBytes)
+    {
+        n += inputBuffer_.shrink(0);
+    }
+    if (outputBuffer_.capacity() > reclaimPolicy_.keepBytes)
+    {
+        n += outputBuffer_.shrink(0);
+    }
+    if (n > 0 && reclaimCounter_)
+    {
+        reclaimCounter_->fetch_add(n, std::memory_order_relaxed);
+    }
+    return n;
+}
+
+size_t TcpConnection::bufferCapacity() const
+{
+    return inputBuffer_.capacity() + outputBuffer_.capacity()
+        + (inputChain_.numBlocks() + outputChain_.numBlocks()) * sizeof(BufferBlock);
+}
@@ -4,16 +4,38 @@
 #include "InetAddress.h"
 #include "Callbacks.h"
 #include "Buffer.h"
+#include "ChainBuffer.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
+#include "SweepNode.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <deque>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 class Channel;
 class EventLoop;
 class Socket;
 
+// 连接缓冲区的内存回收策略（由TcpServer统一设置），用来压低大量空闲长连接的常驻内存
+struct BufferReclaimPolicy
+{
+    BufferReclaimPolicy()
+        : reclaimOnDrain(false), idleIterations(0), idleMs(0), keepBytes(0)
+    {}
+
+    bool reclaimOnDrain;        // 缓冲区被读空/发完之后立即释放底层内存
+    uint64_t idleIterations;    // 连续多少轮事件循环没有读写就回收（0表示不启用）
+    int idleMs;                 // 多少毫秒没有读写就回收（0表示不启用）
+    size_t keepBytes;           // 容量不超过keepBytes的缓冲区不回收，避免小缓冲区反复申请释放
+};
+
+using ReclaimCounterPtr = std::shared_ptr<std::atomic<uint64_t>>;
+
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过accept函数拿到connfd
  * =》 TcpConnection 设置回调 =》 Channel =》 Poller =》 Channel的回调操作
@@ -36,10 +58,61 @@ public:
 
     bool connected() const { return state_ == kConnected; }
 
-    // 发送数据
+    /**
+     * 发送数据，可以在任意线程调用。不在loop线程时，数据要跟着回调一起排队：
+     * const引用和指针版本会拷贝一份，右值string和Buffer*版本直接把数据转移过去
+     */
     void send(const std::string &buf);
+    void send(std::string &&buf);
+    void send(const void *data, size_t len);
+    // 发送buf中的全部可读数据，发送之后buf为空
+    void send(Buffer *buf);
+    // 发送ChainBuffer中的全部数据，只转移块的引用不拷贝（例如把上游的inputBuffer转发给下游）
+    void send(ChainBuffer *buf);
+    /**
+     * 把多个片段（比如响应头、缓存的body、结尾）当成一条消息发送：
+     * 发送队列为空时一次writev发出去，只有没发完的部分才拷贝进发送缓冲区。
+     * 不在loop线程时会先把所有片段拼接成一份拷贝
+     */
+    void sendv(const struct iovec *iov, int iovcnt);
+    /**
+     * 用sendfile(2)发送文件fd中[offset, offset+length)的内容，数据不经过用户态。
+     * 和send的数据按调用顺序发送，高水位和写完成回调也和send一样触发。
+     * 内部会dup一份fd，调用返回后调用者就可以关闭自己的fd
+     */
+    void sendFile(int fd, off_t offset, size_t length);
     // 关闭连接
     void shutdown();
+    // 不等待发送缓冲区发完，直接关闭连接，可以在任意线程调用
+    void forceClose();
+
+    /**
+     * 空闲超时：seconds秒内没有读写事件就forceClose，必须在connectEstablished之前设置。
+     * 连接挂在loop的时间轮上，每次handleRead/handleWrite只是O(1)地刷新到期时间
+     */
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+
+    // 开始/停止读：打开/关闭channel上的EPOLLIN，对端的数据留在内核缓冲区里，可以在任意线程调用
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
+    /**
+     * 输入高水位：读回调返回后，输入缓冲区里没有被消费的数据不少于high字节时自动暂停读，
+     * 之后每轮循环末尾检查一次，降到low字节以下时恢复读。high为0表示不启用，只能在loop线程调用。
+     * high必须大于回调可能留在缓冲区里的最长的不完整消息：否则回调在等剩下的数据，读却停了，
+     * 缓冲区永远降不下来，连接就卡死了
+     */
+    void setInputHighWaterMark(size_t high, size_t low)
+    { inputHighWaterMark_ = high; inputLowWaterMark_ = low; }
+
+    /**
+     * 上游限流（代理转发）：本连接的发送队列超过highWaterMark_时停止upstream的读，
+     * 发送队列降到highWaterMark_的一半以下（或者本连接关闭）时恢复。
+     * upstream可以在另一个loop上，传nullptr解除关联，可以在任意线程调用。
+     * 这个暂停在upstream上单独计数，不会覆盖用户的startRead/stopRead
+     */
+    void setUpstream(const TcpConnectionPtr &upstream);
 
     void setConnectionCallback(const ConnectionCallback& cb)
     { connectionCallback_ = cb; }
@@ -56,6 +129,65 @@ public:
     void setCloseCallback(const CloseCallback& cb)
     { closeCallback_ = cb; }
 
+    /**
+     * 零拷贝发送：不小于threshold字节、且所有权交给了连接的数据（send(std::string&&)和send(Buffer*)）
+     * 用send(MSG_ZEROCOPY)发送，内核直接引用用户内存。数据要等socket错误队列里的完成通知（EPOLLERR）
+     * 到了才释放，shutdown也要等所有通知都到了才关闭写端。连接析构时还有没完成的数据（强制关闭、
+     * 空闲超时、对端关闭），会dup一份socket交给loop，收齐通知后再释放数据、关闭socket（loop先退出的话随loop释放）。
+     * 必须在connectEstablished之前设置，内核不支持时保持普通的拷贝发送
+     */
+    void setZeroCopy(bool on, size_t threshold = kDefaultZeroCopyThreshold);
+    bool zeroCopy() const { return zeroCopy_; }
+    // 零拷贝统计：发送次数、收到完成通知的次数、内核实际退化成拷贝的次数
+    uint64_t zeroCopySends() const { return zeroCopySends_.load(std::memory_order_relaxed); }
+    uint64_t zeroCopyCompletions() const { return zeroCopyCompletions_.load(std::memory_order_relaxed); }
+    uint64_t zeroCopyCopied() const { return zeroCopyCopied_.load(std::memory_order_relaxed); }
+
+    static const size_t kDefaultZeroCopyThreshold = 64 * 1024;
+
+    /**
+     * 合并发送（auto-cork）：loop线程上的send/sendv/send(ChainBuffer*)不再立即write，
+     * 只追加到发送缓冲区，本轮循环末尾（EventLoop::runAtIterationEnd）统一一次write/writev发出去。
+     * 适合一条请求要调用很多次send的协议，只能在loop线程调用
+     */
+    void setAutoCork(bool on) { autoCork_ = on; }
+    bool autoCork() const { return autoCork_; }
+
+    /**
+     * 边沿触发（EPOLLET）：一次事件一直读/写到EAGAIN，热连接不会在每次epoll_wait里都被报一遍。
+     * 一次事件最多读readBudget、写writeBudget字节，预算用完还没到EAGAIN就把剩下的读写排进
+     * pendingFunctors，等这一轮其它活跃连接处理完再接着做，一个很忙的连接不会独占loop。
+     * 必须在connectEstablished之前设置
+     */
+    void setEdgeTriggered(bool on, size_t readBudget = kDefaultReadBudget,
+                          size_t writeBudget = kDefaultWriteBudget);
+    bool edgeTriggered() const { return edgeTriggered_; }
+
+    static const size_t kDefaultReadBudget = 256 * 1024;
+    static const size_t kDefaultWriteBudget = 256 * 1024;
+
+    // 调用send系列接口的次数，和为了发送数据实际执行的write/writev/send/sendfile系统调用次数
+    uint64_t numSendCalls() const { return sendCalls_.load(std::memory_order_relaxed); }
+    uint64_t numWriteSyscalls() const { return writeSyscalls_.load(std::memory_order_relaxed); }
+
+    // 分段缓冲区模式：收发数据都放在由固定大小块组成的ChainBuffer中，必须在connectEstablished之前设置
+    void setSegmentedBuffer(bool on) { segmented_ = on; }
+    bool segmentedBuffer() const { return segmented_; }
+
+    // 分段模式下优先回调ChainMessageCallback，没有设置时把数据拷贝进Buffer，回调MessageCallback
+    void setChainMessageCallback(const ChainMessageCallback& cb)
+    { chainMessageCallback_ = cb; }
+
+    // 设置缓冲区回收策略，counter用来累计回收的字节数（可以为空），必须在connectEstablished之前设置
+    void setBufferReclaimPolicy(const BufferReclaimPolicy &policy, const ReclaimCounterPtr &counter)
+    { reclaimPolicy_ = policy; reclaimCounter_ = counter; }
+
+    // 释放（或收缩）收发缓冲区的底层内存，返回释放的字节数，只能在loop线程调用
+    size_t reclaimBuffers();
+    // 收发缓冲区当前占用的内存，只能在loop线程调用。
+    // 和其它连接共享的块（零拷贝转发）每个持有者都会算一遍，所以各连接的和是上界
+    size_t bufferCapacity() const;
+
     // 连接建立
     void connectEstablished();
     // 连接销毁
@@ -70,12 +202,73 @@ private:
     void handleError();
 
     void sendInLoop(const void* message, size_t len);
+    void sendStringInLoop(const std::string &message);
+    void sendvInLoop(const struct iovec *iov, int iovcnt);
+    // holder持有data指向的内存，直到内核通知这次发送完成
+    void sendZeroCopyInLoop(const std::shared_ptr<void> &holder, const char *data, size_t len);
+    // 从socket错误队列中取出MSG_ZEROCOPY的完成通知，释放内核已经用完的数据，返回是否取到了通知
+    bool handleZeroCopyCompletions();
+    void sendChainInLoop(ChainBuffer *buf);
+    void sendFileInLoop(int fd, off_t offset, size_t length);
+    // 待发送数据总量（outputBuffer_ + outputChain_ + 排队中的文件）
+    size_t outputBytes() const;
+    // 待发送数据将要增加len字节，跨过高水位时回调highWaterMarkCallback_
+    void checkHighWaterMark(size_t len);
+    // 把没发出去的数据追加到发送队列末尾
+    void appendOutput(const char* data, size_t len);
+    void appendOutput(ChainBuffer *buf);
+    // 发送文件队列头部的文件，发完之后把排在它后面的数据挪到outputChain_
+    ssize_t sendPendingFile(int *saveErrno);
+    // 发送队列头部的数据做一次write/writev/sendfile
+    ssize_t writeOutput(int *saveErrno);
+    // 读一次socket，读到数据就回调messageCallback_，返回readFd的结果
+    ssize_t readSocket(Timestamp receiveTime, int *savedErrno);
+    // 边沿触发模式下的读写：读写到EAGAIN或者用完预算
+    void handleReadEdgeTriggered(Timestamp receiveTime);
+    void handleWriteEdgeTriggered();
+    // 预算用完后排进队列的续读、续写
+    void continueRead();
+    void continueWrite();
+    // 发送队列清空：关闭epollout、回收缓冲区、回调writeCompleteCallback_，正在关闭时shutdownWrite
+    void outputDrained();
+    // 数据追加到发送队列之后调用：合并发送时安排本轮末尾flush，否则注册epollout
+    void scheduleWrite();
+    // 本轮末尾把合并的数据发出去
+    void flushCorked();
     void shutdownInLoop();
+    void forceCloseInLoop();
+    // 时间轮到期回调
+    void onIdleTimeout();
+
+    void startReadInLoop();
+    void stopReadInLoop();
+    void setUpstreamInLoop(const TcpConnectionPtr &upstream);
+    // 作为上游被下游暂停/恢复读，可以在任意线程调用
+    void pauseByDownstream(bool pause);
+    void pauseByDownstreamInLoop(bool pause);
+    // 按reading_和inputPaused_打开或关闭channel的EPOLLIN
+    void updateReading();
+    // 输入缓冲区中还没被消费的数据（inputBuffer_ + inputChain_）
+    size_t inputBytes() const;
+    // 自动暂停读之后，每轮循环末尾检查一次输入缓冲区是否降到了低水位
+    void checkInputResume();
+    // 发送队列降下来（或者连接关闭）以后恢复上游的读
+    void resumeUpstream(bool force);
+
+    // 记录最近一次读写发生的轮数和时间，供空闲回收判断
+    void touch();
+    // 由EventLoop的清理回调周期性调用，空闲超过阈值就回收缓冲区
+    void reclaimIfIdle();
+    static void sweepCallback(void *conn) { static_cast<TcpConnection*>(conn)->reclaimIfIdle(); }
 
     EventLoop *loop_; // 这里绝对不是baseLoop， 因为TcpConnection都是在subLoop里面管理的
     const std::string name_;
     std::atomic_int state_;
-    bool reading_;
+    bool reading_;        // 用户是否要读（startRead/stopRead）
+    bool inputPaused_;    // 是否因为输入高水位自动暂停了读
+    int downstreamPauses_;    // 作为上游被几个发送队列过高的下游暂停了读
+    size_t inputHighWaterMark_;
+    size_t inputLowWaterMark_;
 
     // 这里和Acceptor类似   Acceptor=》mainLoop    TcpConenction=》subLoop
     std::unique_ptr<Socket> socket_;
@@ -89,8 +282,63 @@ private:
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
     HighWaterMarkCallback highWaterMarkCallback_;
     CloseCallback closeCallback_;
+    ChainMessageCallback chainMessageCallback_;
     size_t highWaterMark_;
+    std::weak_ptr<TcpConnection> upstream_;   // 发送队列过高时要暂停读的上游连接
+    bool upstreamPaused_;
+    bool segmented_;      // 是否使用分段缓冲区
+    bool autoCork_;       // 是否合并一轮循环内的发送
+    bool corkFlushPending_;   // 已经安排了本轮末尾的flush
+    bool edgeTriggered_;      // 是否以EPOLLET注册
+    size_t readBudget_;       // 边沿触发时一次事件最多读的字节数
+    size_t writeBudget_;      // 边沿触发时一次事件最多写的字节数
+    bool readRequeued_;       // 已经排了续读
+    bool writeRequeued_;      // 已经排了续写
+    std::atomic<uint64_t> sendCalls_;
+    std::atomic<uint64_t> writeSyscalls_;
+
+    BufferReclaimPolicy reclaimPolicy_;
+    ReclaimCounterPtr reclaimCounter_;
+    SweepNode sweepNode_;             // 挂在loop清理回调链表上的节点，connectDestroyed时摘下
+    uint64_t lastActiveIteration_;
+    Timestamp lastActiveTime_;
+
+    double idleTimeout_;             // 0表示不启用
+    TimingWheel::Node idleNode_;     // 挂在loop时间轮上的节点
 
     Buffer inputBuffer_;  // 接收数据的缓冲区
     Buffer outputBuffer_; // 发送数据的缓冲区
+    // 分段模式下的收发缓冲区。outputChain_中的数据总是排在outputBuffer_之后发送
+    ChainBuffer inputChain_;
+    ChainBuffer outputChain_;
+
+    // 等待sendfile的文件，排在outputChain_之后。文件之后send的数据放在它的trailer里
+    struct PendingFile
+    {
+        int fd;
+        off_t offset;
+        size_t remaining;
+        ChainBuffer trailer;
+    };
+    std::deque<PendingFile> pendingFiles_;
+
+    // MSG_ZEROCOPY发送中、内核还在引用的数据，按序号排列
+    struct ZeroCopyBuffer
+    {
+        uint32_t seq;                   // 和内核给每次零拷贝send的计数一致
+        std::shared_ptr<void> holder;
+    };
+    using ZeroCopyList = std::deque<ZeroCopyBuffer>;
+    // 从fd的错误队列中取出完成通知，内核已经用完的数据从pending中出队，通知次数累加到completions/copied，
+    // 返回是否取到了通知
+    static bool reapZeroCopyCompletions(int fd, ZeroCopyList *pending, uint64_t *completions, uint64_t *copied);
+    // 连接析构后继续等待pending的完成通知：fd是dup出来的socket，全部完成后释放数据、关闭fd
+    static void lingerZeroCopy(EventLoop *loop, int fd, const std::shared_ptr<ZeroCopyList> &pending);
+    bool zeroCopy_;
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopyNextSeq_;
+    ZeroCopyList zeroCopyPending_;
+    std::atomic<uint64_t> zeroCopySends_;
+    std::atomic<uint64_t> zeroCopyCompletions_;
+    std::atomic<uint64_t> zeroCopyCopied_;
 };
\ No newline at end of file
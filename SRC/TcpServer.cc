@@ -26,8 +26,19 @@ TcpServer::TcpServer(EventLoop *loop,
                 , threadPool_(new EventLoopThreadPool(loop, name_))
                 , connectionCallback_()
                 , messageCallback_()
-                , nextConnId_(1)
                 , started_(0)
+                , nextConnId_(1)
+                , segmentedBuffer_(false)
+                , zeroCopy_(false)
+                , zeroCopyThreshold_(TcpConnection::kDefaultZeroCopyThreshold)
+                , autoCork_(false)
+                , edgeTriggered_(false)
+                , readBudget_(TcpConnection::kDefaultReadBudget)
+                , writeBudget_(TcpConnection::kDefaultWriteBudget)
+                , inputHighWaterMark_(0)
+                , inputLowWaterMark_(0)
+                , idleTimeout_(0)
+                , reclaimCounter_(std::make_shared<std::atomic<uint64_t>>(0))
 {
     // 当有先用户连接时，会执行TcpServer::newConnection回调
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, 
@@ -55,6 +66,11 @@ void TcpServer::setThreadNum(int numThreads)
     threadPool_->setThreadNum(numThreads);
 }
 
+void TcpServer::setBusyPoll(int budgetUs, int index)
+{
+    threadPool_->setBusyPoll(budgetUs, index);
+}
+
 // 开启服务器监听   loop.loop()
 void TcpServer::start()
 {
@@ -100,6 +116,20 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setChainMessageCallback(chainMessageCallback_);
+    conn->setSegmentedBuffer(segmentedBuffer_);
+    conn->setAutoCork(autoCork_);
+    if (edgeTriggered_)
+    {
+        conn->setEdgeTriggered(true, readBudget_, writeBudget_);
+    }
+    conn->setInputHighWaterMark(inputHighWaterMark_, inputLowWaterMark_);
+    conn->setIdleTimeout(idleTimeout_);
+    conn->setBufferReclaimPolicy(reclaimPolicy_, reclaimCounter_);
+    if (zeroCopy_)
+    {
+        conn->setZeroCopy(true, zeroCopyThreshold_);
+    }
 
     // 设置了如何关闭连接的回调   conn->shutDown()
     conn->setCloseCallback(
@@ -107,7 +137,8 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
     );
 
     // 直接调用TcpConnection::connectEstablished
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    // 高优先级：不排在subloop里大量的发送回调后面
+    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn), EventLoop::kHighPriority);
 }
 
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
@@ -40,10 +40,44 @@ public:
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    void setChainMessageCallback(const ChainMessageCallback &cb) { chainMessageCallback_ = cb; }
+
+    // 新连接是否使用分段缓冲区（ChainBuffer）
+    void setSegmentedBuffer(bool on) { segmentedBuffer_ = on; }
+
+    // 新连接是否对大块数据使用MSG_ZEROCOPY发送
+    void setZeroCopy(bool on, size_t threshold = TcpConnection::kDefaultZeroCopyThreshold)
+    { zeroCopy_ = on; zeroCopyThreshold_ = threshold; }
+
+    // 新连接的输入高水位，输入缓冲区积压超过high字节时暂停读，降到low字节以下恢复
+    void setInputHighWaterMark(size_t high, size_t low)
+    { inputHighWaterMark_ = high; inputLowWaterMark_ = low; }
+
+    // 新连接的空闲超时（秒），超时没有读写的连接会被强制关闭，0表示不启用
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+
+    // 新连接是否合并一轮循环内的多次send（auto-cork）
+    void setAutoCork(bool on) { autoCork_ = on; }
+
+    // 新连接是否以边沿触发注册，以及每次事件的读写预算（见TcpConnection::setEdgeTriggered）
+    void setEdgeTriggered(bool on, size_t readBudget = TcpConnection::kDefaultReadBudget,
+                          size_t writeBudget = TcpConnection::kDefaultWriteBudget)
+    { edgeTriggered_ = on; readBudget_ = readBudget; writeBudget_ = writeBudget; }
+
+    // 新连接的缓冲区回收策略
+    void setBufferReclaimPolicy(const BufferReclaimPolicy &policy) { reclaimPolicy_ = policy; }
+    // 所有连接累计回收的缓冲区字节数
+    uint64_t bytesReclaimed() const { return reclaimCounter_->load(std::memory_order_relaxed); }
 
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
 
+    // subloop的busy-poll空转预算（微秒），index为-1表示所有subloop，0表示关闭
+    void setBusyPoll(int budgetUs, int index = -1);
+
+    // 底层的loop线程池，start之后可以用getAllLoops()取各个subloop（例如读取它们的stats()）
+    std::shared_ptr<EventLoopThreadPool> threadPool() const { return threadPool_; }
+
     // 开启服务器监听
     void start();
 private:
@@ -65,11 +99,24 @@ private:
     ConnectionCallback connectionCallback_; // 有新连接时的回调
     MessageCallback messageCallback_; // 有读写消息时的回调
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
+    ChainMessageCallback chainMessageCallback_; // 分段缓冲区模式下有读写消息时的回调
 
     ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
 
     std::atomic_int started_;
 
     int nextConnId_;
+    bool segmentedBuffer_;
+    bool zeroCopy_;
+    size_t zeroCopyThreshold_;
+    bool autoCork_;
+    bool edgeTriggered_;
+    size_t readBudget_;
+    size_t writeBudget_;
+    size_t inputHighWaterMark_;
+    size_t inputLowWaterMark_;
+    double idleTimeout_;
+    BufferReclaimPolicy reclaimPolicy_;
+    ReclaimCounterPtr reclaimCounter_;
     ConnectionMap connections_; // 保存所有的连接
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+
+#include <atomic>
+#include <stdint.h>
+
+// 定时器：到期时间、回调、重复间隔（interval > 0 表示周期定时器）
+class Timer : noncopyable
+{
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(interval)
+        , repeat_(interval > 0.0)
+        , sequence_(s_numCreated_.fetch_add(1, std::memory_order_relaxed) + 1)
+    {}
+
+    void run() const { callback_(); }
+
+    Timestamp expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    // 周期定时器从now开始重新计时
+    void restart(Timestamp now);
+
+    static int64_t numCreated() { return s_numCreated_.load(std::memory_order_relaxed); }
+private:
+    const TimerCallback callback_;
+    Timestamp expiration_;
+    const double interval_;
+    const bool repeat_;
+    const int64_t sequence_;
+
+    static std::atomic<int64_t> s_numCreated_;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+class Timer;
+
+// 定时器的句柄（可以拷贝），只用来取消定时器。
+// Timer被释放后地址可能被新的Timer复用，所以还要带上序号区分
+class TimerId
+{
+public:
+    TimerId() : timer_(nullptr), sequence_(0) {}
+    TimerId(Timer *timer, int64_t seq) : timer_(timer), sequence_(seq) {}
+
+    friend class TimerQueue;
+private:
+    Timer *timer_;
+    int64_t sequence_;
+};
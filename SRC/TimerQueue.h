@@ -0,0 +1,60 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+#include "Channel.h"
+#include "TimerId.h"
+
+#include <set>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+class EventLoop;
+class Timer;
+
+/**
+ * 每个EventLoop一个的定时器队列：所有定时器按到期时间排在一个有序集合里，
+ * 用一个timerfd（作为Channel注册到poller）定在最早的到期时间上，timerfd可读时取出所有到期的定时器执行。
+ * 插入、取消、到期都是O(logN)
+ */
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 添加定时器，可以在任意线程调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    // 取消定时器，可以在任意线程调用。定时器已经到期（一次性的）或者已经取消时什么也不做
+    void cancel(TimerId timerId);
+
+    // 还没到期的定时器个数（只在loop线程上准确）
+    size_t size() const { return timers_.size(); }
+private:
+    using Entry = std::pair<Timestamp, Timer*>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer*, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读
+    void handleRead();
+    // 取出所有到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    // 周期定时器重新插入，其余的释放，然后把timerfd定到新的最早到期时间
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+    // 返回最早到期的定时器是否变了
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    TimerList timers_;              // 按到期时间排序
+    ActiveTimerSet activeTimers_;   // 和timers_里的定时器一样，按地址排序，用来取消
+
+    bool callingExpiredTimers_;
+    ActiveTimerSet cancelingTimers_;    // 执行到期回调期间被取消的定时器（周期定时器不再重新插入）
+};
@@ -0,0 +1,241 @@
+#include "TimingWheel.h"
+#include "EventLoop.h"
+
+#include <math.h>
+
+const int TimingWheel::kLevel0Bits;
+const int TimingWheel::kLevelBits;
+const int TimingWheel::kNumLevels;
+const int TimingWheel::kLevel0Size;
+const int TimingWheel::kLevelSize;
+
+TimingWheel::TimingWheel(EventLoop *loop, double tickSeconds)
+    : loop_(loop)
+    , tickSeconds_(tickSeconds)
+    , currentTick_(0)
+    , size_(0)
+    , expiredCount_(0)
+    , timerRunning_(false)
+{
+    for (Slot &slot : level0_)
+    {
+        slot.head.prev = slot.head.next = &slot.head;
+    }
+    for (auto &level : levels_)
+    {
+        for (Slot &slot : level)
+        {
+            slot.head.prev = slot.head.next = &slot.head;
+        }
+    }
+}
+
+// 周期定时器由TimerQueue释放，这里不再cancel（析构时loop可能已经不在运行）
+TimingWheel::~TimingWheel()
+{
+}
+
+void TimingWheel::add(Node *node, double timeout, ExpireCallback cb)
+{
+    remove(node);
+    if (!timerRunning_)
+    {
+        startTimer();
+    }
+    node->callback = std::move(cb);
+    node->timeoutTicks = static_cast<uint64_t>(::ceil(timeout / tickSeconds_));
+    if (node->timeoutTicks == 0)
+    {
+        node->timeoutTicks = 1;
+    }
+    node->deadline = deadlineAfter(node->timeoutTicks);
+    link(node);
+    ++size_;
+}
+
+void TimingWheel::refresh(Node *node)
+{
+    if (!node->linked())
+    {
+        return;
+    }
+    uint64_t deadline = deadlineAfter(node->timeoutTicks);
+    if (deadline >= node->deadline)
+    {
+        node->deadline = deadline;  // 往后推：只改到期时间，槽转到时再挂到新位置
+    }
+    else
+    {
+        unlink(node);
+        node->deadline = deadline;
+        link(node);
+    }
+}
+
+void TimingWheel::remove(Node *node)
+{
+    if (node->linked())
+    {
+        unlink(node);
+        --size_;
+    }
+}
+
+void TimingWheel::unlink(Node *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+}
+
+void TimingWheel::append(Node *head, Node *node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+// currentTick_是下一个要处理的tick，按到期时间离它多远决定挂在哪一层
+void TimingWheel::link(Node *node)
+{
+    uint64_t expires = node->deadline < currentTick_ ? currentTick_ : node->deadline;
+    uint64_t delta = expires - currentTick_;
+    if (delta < static_cast<uint64_t>(kLevel0Size))
+    {
+        append(&level0_[expires & (kLevel0Size - 1)].head, node);
+        return;
+    }
+
+    int shift = kLevel0Bits;
+    for (int level = 0; level < kNumLevels - 1; ++level, shift += kLevelBits)
+    {
+        uint64_t range = 1ULL << (shift + kLevelBits);
+        if (delta < range || level == kNumLevels - 2)
+        {
+            if (delta >= range)
+            {
+                expires = currentTick_ + range - 1;    // 超出最大范围，先挂在最后，转到时再重新挂
+            }
+            append(&levels_[level][(expires >> shift) & (kLevelSize - 1)].head, node);
+            return;
+        }
+    }
+}
+
+void TimingWheel::cascade(Slot *slot)
+{
+    Node *head = &slot->head;
+    while (head->next != head)
+    {
+        Node *node = head->next;
+        unlink(node);
+        link(node);
+    }
+}
+
+// 到期的节点挂到expired链表上，仍然计在size_里，回调前才摘下来
+void TimingWheel::tick(Node *expired)
+{
+    const size_t index = currentTick_ & (kLevel0Size - 1);
+    if (index == 0)
+    {
+        // 第0层转完一圈，把上一层对应槽里的节点分散下来，上一层也转完一圈时继续往上
+        int shift = kLevel0Bits;
+        for (int level = 0; level < kNumLevels - 1; ++level, shift += kLevelBits)
+        {
+            size_t i = (currentTick_ >> shift) & (kLevelSize - 1);
+            cascade(&levels_[level][i]);
+            if (i != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    // 先把整个槽摘下来，再逐个处理
+    Node *head = &level0_[index].head;
+    Node list;
+    list.prev = list.next = &list;
+    if (head->next != head)
+    {
+        list.next = head->next;
+        list.prev = head->prev;
+        list.next->prev = &list;
+        list.prev->next = &list;
+        head->prev = head->next = head;
+    }
+
+    const uint64_t now = currentTick_++;
+    while (list.next != &list)
+    {
+        Node *node = list.next;
+        unlink(node);
+        if (node->deadline > now)
+        {
+            link(node);             // 中途refresh过，还没到期
+        }
+        else
+        {
+            append(expired, node);
+        }
+    }
+}
+
+void TimingWheel::onTimer()
+{
+    int64_t elapsed = Timestamp::now().microSecondsSinceEpoch() - base_.microSecondsSinceEpoch();
+    uint64_t target = static_cast<uint64_t>(elapsed / (tickSeconds_ * Timestamp::kMicroSecondsPerSecond));
+
+    // 到期的节点放在侵入式的临时链表上而不是保存指针：前面的回调remove（或者重新add）了后面的节点时，
+    // 节点直接从这个链表上摘掉，不会留下悬空的指针，也不会再被回调
+    Node expired;
+    expired.prev = expired.next = &expired;
+    while (currentTick_ <= target)
+    {
+        tick(&expired);
+    }
+
+    while (expired.next != &expired)
+    {
+        Node *node = expired.next;
+        unlink(node);
+        --size_;
+        ++expiredCount_;
+        node->callback();       // 回调之后不能再碰node，所有者可能已经销毁了
+    }
+
+    if (size_ == 0 && timerRunning_)
+    {
+        loop_->cancel(timerId_);
+        timerRunning_ = false;
+    }
+}
+
+uint64_t TimingWheel::nowTick() const
+{
+    Timestamp now = loop_->pollReturnTime();
+    if (!now.valid())   // loop还没有poll过
+    {
+        now = Timestamp::now();
+    }
+    // currentTick_是下一个要处理的tick，现在至少已经到了上一个处理过的tick。
+    // 不能取currentTick_，否则tick处理完之后、时间还没走到下一个tick时添加的节点会晚一整个tick
+    const uint64_t last = currentTick_ > 0 ? currentTick_ - 1 : 0;
+    int64_t elapsed = now.microSecondsSinceEpoch() - base_.microSecondsSinceEpoch();
+    if (elapsed <= 0)
+    {
+        return last;
+    }
+    uint64_t tick = static_cast<uint64_t>(elapsed / (tickSeconds_ * Timestamp::kMicroSecondsPerSecond));
+    return tick > last ? tick : last;
+}
+
+void TimingWheel::startTimer()
+{
+    // 定时器停着的时候tick也停着，重新对齐base_，让currentTick_对应现在
+    int64_t offset = static_cast<int64_t>(currentTick_ * tickSeconds_ * Timestamp::kMicroSecondsPerSecond);
+    base_ = Timestamp(Timestamp::now().microSecondsSinceEpoch() - offset);
+    timerId_ = loop_->runEvery(tickSeconds_, std::bind(&TimingWheel::onTimer, this));
+    timerRunning_ = true;
+}
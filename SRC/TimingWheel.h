@@ -0,0 +1,98 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <stdint.h>
+#include <stddef.h>
+
+class EventLoop;
+
+/**
+ * 分层时间轮（类似Linux内核的timer wheel），用来管理大量连接的空闲超时。
+ * 第0层256个槽，每槽一个tick；第1~3层各64个槽，每槽覆盖下一层一整圈。
+ * 节点侵入式地嵌在使用者（例如TcpConnection）里，添加、删除都是O(1)，不分配内存。
+ * refresh只改节点的到期tick、不挪链表（惰性）：节点所在的槽转到时发现还没到期，再按新的到期时间挂回去。
+ * 时间轮由loop上的一个周期定时器推动，轮上没有节点时定时器停掉。只能在loop线程使用。
+ * 超时从本轮poll返回的时间算起，到期不会早于timeout，最多晚一个tick加上一轮循环的耗时
+ */
+class TimingWheel : noncopyable
+{
+public:
+    using ExpireCallback = std::function<void()>;
+
+    struct Node
+    {
+        Node() : prev(nullptr), next(nullptr), deadline(0), timeoutTicks(0) {}
+
+        bool linked() const { return prev != nullptr; }
+
+        Node *prev;
+        Node *next;
+        uint64_t deadline;      // 到期的tick
+        uint64_t timeoutTicks;  // refresh时往后推的tick数
+        ExpireCallback callback;
+    };
+
+    static const int kLevel0Bits = 8;
+    static const int kLevelBits = 6;
+    static const int kNumLevels = 4;
+
+    TimingWheel(EventLoop *loop, double tickSeconds);
+    ~TimingWheel();
+
+    /**
+     * 挂上节点，timeout秒之后回调cb（回调前节点已经摘下来了，回调里可以销毁节点的所有者）。
+     * 同一批到期的其它节点在回调前一直挂在一个临时链表上，回调里remove它们就不会再被回调；
+     * 但不能不remove就销毁它们的所有者，要销毁只能延后（例如TcpConnection排进队列的forceClose）
+     */
+    void add(Node *node, double timeout, ExpireCallback cb);
+    // 从现在开始重新计时，O(1)
+    void refresh(Node *node);
+    // 摘下节点，没挂在轮上时什么也不做
+    void remove(Node *node);
+
+    size_t size() const { return size_; }
+    double tickSeconds() const { return tickSeconds_; }
+    // 累计到期的节点数
+    uint64_t expiredCount() const { return expiredCount_; }
+private:
+    static const int kLevel0Size = 1 << kLevel0Bits;
+    static const int kLevelSize = 1 << kLevelBits;
+
+    // 每个槽是一个带头结点的双向循环链表
+    struct Slot
+    {
+        Node head;
+    };
+
+    void link(Node *node);
+    static void unlink(Node *node);
+    // 挂到带头结点的双向循环链表的末尾
+    static void append(Node *head, Node *node);
+    // 把一个槽里的节点按到期时间重新挂到轮上
+    void cascade(Slot *slot);
+    // 前进一个tick，到期的节点放进expired
+    void tick(Node *expired);
+    // 周期定时器回调：按经过的时间补齐tick，再批量回调到期的节点
+    void onTimer();
+    void startTimer();
+    // 按本轮poll返回的时间算出现在所在的tick（向下取整，不小于上一个处理过的tick），不需要额外的系统调用
+    uint64_t nowTick() const;
+    // 从现在开始timeoutTicks个tick之后的到期tick。nowTick是向下取整的，要多加一个tick，保证不会提前到期
+    uint64_t deadlineAfter(uint64_t timeoutTicks) const { return nowTick() + timeoutTicks + 1; }
+
+    EventLoop *loop_;
+    const double tickSeconds_;
+    uint64_t currentTick_;
+    Timestamp base_;            // currentTick_为0时对应的时间
+    size_t size_;
+    uint64_t expiredCount_;
+    bool timerRunning_;
+    TimerId timerId_;
+
+    Slot level0_[kLevel0Size];
+    Slot levels_[kNumLevels - 1][kLevelSize];
+};
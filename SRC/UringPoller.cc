@@ -0,0 +1,334 @@
+#include "UringPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// channel的成员index_，含义和EPollPoller一样
+const int kNew = -1;    // 一个channel还没有添加到poller之中
+const int kAdded = 1;   // 一个channel已经添加到poller之中
+const int kDeleted = 2; // 一个channel已经在poller之中删除
+
+const unsigned UringPoller::kRingEntries;
+const uint64_t UringPoller::kRemoveUserData;
+
+namespace
+{
+int ioUringSetup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+uint64_t makeUserData(int fd, uint32_t gen)
+{
+    return static_cast<uint64_t>(gen) << 32 | static_cast<uint32_t>(fd);
+}
+}
+
+bool UringPoller::available()
+{
+    static const bool supported = []() {
+        io_uring_params params;
+        bzero(&params, sizeof params);
+        int fd = ioUringSetup(4, &params);
+        if (fd < 0)
+        {
+            return false;
+        }
+        ::close(fd);
+        return (params.features & IORING_FEAT_EXT_ARG) != 0;
+    }();
+    return supported;
+}
+
+UringPoller::UringPoller(EventLoop *loop)
+    : Poller(loop)
+    , ringFd_(-1)
+    , sqRing_(MAP_FAILED)
+    , cqRing_(MAP_FAILED)
+    , sqes_(nullptr)
+    , sqLocalTail_(0)
+{
+    io_uring_params params;
+    bzero(&params, sizeof params);
+    ringFd_ = ioUringSetup(kRingEntries, &params);
+    if (ringFd_ < 0)
+    {
+        LOG_FATAL("io_uring_setup error:%d \n", errno);
+    }
+    sqEntries_ = params.sq_entries;
+    cqEntries_ = params.cq_entries;
+
+    sqRingSize_ = params.sq_off.array + sqEntries_ * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + cqEntries_ * sizeof(io_uring_cqe);
+    const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap)
+    {
+        // SQ和CQ在同一块内存里，按大的那个映射一次
+        if (cqRingSize_ > sqRingSize_)
+        {
+            sqRingSize_ = cqRingSize_;
+        }
+        cqRingSize_ = sqRingSize_;
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        LOG_FATAL("io_uring mmap sq ring error:%d \n", errno);
+    }
+    cqRing_ = singleMmap ? sqRing_
+            : ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd_, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED)
+    {
+        LOG_FATAL("io_uring mmap cq ring error:%d \n", errno);
+    }
+    void *sqes = ::mmap(nullptr, sqEntries_ * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        LOG_FATAL("io_uring mmap sqes error:%d \n", errno);
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char *sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char *cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    sqLocalTail_ = *sqTail_;
+}
+
+UringPoller::~UringPoller()
+{
+    ::munmap(sqes_, sqEntries_ * sizeof(io_uring_sqe));
+    if (cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    ::munmap(sqRing_, sqRingSize_);
+    ::close(ringFd_);
+}
+
+Timestamp UringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_DEBUG("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels());
+
+    // 上一轮完成了的单次poll请求重新挂上，和这次等待一起提交
+    for (int fd : rearm_)
+    {
+        Registration &reg = registrations_[fd];
+        if (reg.channel != nullptr && !reg.armed && !reg.channel->isNoneEvent())
+        {
+            arm(fd, reg);
+        }
+    }
+    rearm_.clear();
+
+    int ret = submitAndWait(timeoutMs);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    size_t before = activeChannels->size();
+    fillActiveChannels(activeChannels);
+    if (activeChannels->size() > before)
+    {
+        LOG_DEBUG("%lu events happend \n", activeChannels->size() - before);
+    }
+    else if (ret < 0 && saveErrno != ETIME && saveErrno != EINTR)
+    {
+        errno = saveErrno;
+        LOG_ERROR("UringPoller::poll() err:%d \n", saveErrno);
+    }
+    return now;
+}
+
+// 和EPollPoller一样的状态转换，epoll_ctl换成往SQ里放请求
+void UringPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    const int fd = channel->fd();
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n",
+         __FUNCTION__, fd, channel->events(), index);
+
+    Registration &reg = registration(fd);
+    if (index == kNew || index == kDeleted)
+    {
+        if (index == kNew)
+        {
+            addChannel(fd, channel);
+        }
+        channel->set_index(kAdded);
+        reg.channel = channel;
+        arm(fd, reg);
+    }
+    else
+    {
+        if (channel->isNoneEvent())
+        {
+            disarm(fd, reg);
+            channel->set_index(kDeleted);
+        }
+        else
+        {
+            arm(fd, reg);
+        }
+    }
+}
+
+void UringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    eraseChannel(fd);
+
+    LOG_DEBUG("func=%s => fd=%d \n", __FUNCTION__, fd);
+
+    Registration &reg = registration(fd);
+    disarm(fd, reg);
+    reg.channel = nullptr;
+    ++reg.gen;      // 已经在CQ里、还没取出来的完成事件作废
+    channel->set_index(kNew);
+}
+
+UringPoller::Registration& UringPoller::registration(int fd)
+{
+    if (static_cast<size_t>(fd) >= registrations_.size())
+    {
+        size_t size = registrations_.size() * 2;
+        if (size <= static_cast<size_t>(fd))
+        {
+            size = fd + 1;
+        }
+        registrations_.resize(size, Registration{nullptr, 0, false});
+    }
+    return registrations_[fd];
+}
+
+// 挂上一个新的poll请求，已经挂着的先撤掉（感兴趣的事件变了）
+void UringPoller::arm(int fd, Registration &reg)
+{
+    disarm(fd, reg);
+    ++reg.gen;
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = static_cast<uint32_t>(reg.channel->events());  // poll和epoll的事件位是一样的
+    sqe->user_data = makeUserData(fd, reg.gen);
+    reg.armed = true;
+}
+
+void UringPoller::disarm(int fd, Registration &reg)
+{
+    if (!reg.armed)
+    {
+        return;
+    }
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(fd, reg.gen);
+    sqe->user_data = kRemoveUserData;
+    reg.armed = false;
+    ++reg.gen;      // 被取消的请求还会产生一个-ECANCELED的完成事件，丢掉
+}
+
+io_uring_sqe* UringPoller::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head >= sqEntries_)
+    {
+        // SQ满了，先把攒着的请求提交掉（不等待）
+        submitAndWait(0);
+    }
+    unsigned index = sqLocalTail_ & sqMask_;
+    sqArray_[index] = index;
+    ++sqLocalTail_;
+    io_uring_sqe *sqe = &sqes_[index];
+    bzero(sqe, sizeof *sqe);
+    return sqe;
+}
+
+// 提交SQ里的请求，timeoutMs不为0并且CQ是空的时候等待至少一个完成事件
+int UringPoller::submitAndWait(int timeoutMs)
+{
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+    unsigned toSubmit = sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    bool cqEmpty = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE) == *cqHead_;
+    bool wait = timeoutMs != 0 && cqEmpty;
+    if (toSubmit == 0 && !wait)
+    {
+        return 0;
+    }
+
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    unsigned minComplete = wait ? 1 : 0;
+    if (wait && timeoutMs > 0)
+    {
+        __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+        io_uring_getevents_arg arg;
+        bzero(&arg, sizeof arg);
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        return ioUringEnter(ringFd_, toSubmit, minComplete, flags | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+    }
+    return ioUringEnter(ringFd_, toSubmit, minComplete, flags, nullptr, _NSIG / 8);
+}
+
+void UringPoller::fillActiveChannels(ChannelList *activeChannels)
+{
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe &cqe = cqes_[head & cqMask_];
+        if (cqe.user_data == kRemoveUserData)
+        {
+            continue;
+        }
+        int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+        uint32_t gen = static_cast<uint32_t>(cqe.user_data >> 32);
+        if (static_cast<size_t>(fd) >= registrations_.size())
+        {
+            continue;
+        }
+        Registration &reg = registrations_[fd];
+        if (reg.gen != gen || reg.channel == nullptr)
+        {
+            continue;   // 已经撤掉或者fd被复用了的旧请求
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+        {
+            reg.armed = false;
+        }
+        if (cqe.res < 0)
+        {
+            // 请求本身失败了，不再重新挂上，等channel下一次updateChannel
+            LOG_ERROR("UringPoller poll fd=%d err:%d \n", fd, -cqe.res);
+            continue;
+        }
+        rearm_.push_back(fd);
+        reg.channel->set_revents(cqe.res);
+        activeChannels->push_back(reg.channel);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
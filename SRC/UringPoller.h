@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+class Channel;
+
+/**
+ * io_uring实现的Poller（直接用系统调用，不依赖liburing），设置环境变量MUDUO_USE_URING启用。
+ * 每个channel对应一个IORING_OP_POLL_ADD请求，poll返回的事件掩码和epoll的一样，Channel不用改。
+ * 注册、修改、注销都只是往SQ里放请求，留到下一次poll时和等待一起用一次io_uring_enter提交。
+ *
+ * io_uring_setup   ----------------> 构造、析构
+ * POLL_ADD/POLL_REMOVE ------------> updateChannel、removeChannel
+ * io_uring_enter（提交 + 等待）----> poll函数
+ *
+ * 用的是单次的poll请求，每次完成后重新挂上：多次触发的poll（IORING_POLL_ADD_MULTI）
+ * 只在有新的唤醒时才产生完成事件，相当于边沿触发，而TcpConnection每次事件只读一次，
+ * 读不完的数据会一直等不到通知。重新挂上的请求和下一次等待在同一个系统调用里提交
+ */
+class UringPoller : public Poller
+{
+public:
+    UringPoller(EventLoop *loop);       // io_uring_setup
+    ~UringPoller() override;
+
+    // 内核是否支持（io_uring没被禁用，并且支持带超时的io_uring_enter）
+    static bool available();
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;  // io_uring_enter
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+private:
+    static const unsigned kRingEntries = 1024;
+    static const uint64_t kRemoveUserData = ~0ULL;  // POLL_REMOVE请求自己的完成事件
+
+    // 每个fd当前的poll请求，user_data里带上gen，旧请求的完成事件（已取消或者fd被复用）直接丢掉
+    struct Registration
+    {
+        Channel *channel;
+        uint32_t gen;
+        bool armed;         // 内核里有这个fd正在等待的poll请求
+    };
+
+    Registration& registration(int fd);
+    void arm(int fd, Registration &reg);
+    void disarm(int fd, Registration &reg);
+    io_uring_sqe* getSqe();
+    int submitAndWait(int timeoutMs);
+    void fillActiveChannels(ChannelList *activeChannels);
+
+    int ringFd_;
+    unsigned sqEntries_;
+    unsigned cqEntries_;
+    void *sqRing_;
+    size_t sqRingSize_;
+    void *cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe *sqes_;
+
+    // SQ、CQ在共享内存里的各个字段
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned sqMask_;
+    unsigned *sqArray_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+
+    unsigned sqLocalTail_;      // SQ里sqHead_到sqLocalTail_之间是还没有交给内核的请求
+
+    std::vector<Registration> registrations_;   // 以fd为下标
+    std::vector<int> rearm_;                    // 本轮完成了的fd，下一次poll之前重新挂上
+};
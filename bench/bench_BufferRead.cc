@@ -0,0 +1,201 @@
+// Buffer::readFd（readv + 栈上64K）和朴素read()循环的对比：
+// 每次系统调用读到的字节数、吞吐，以及空闲连接占用的内存
+#include "Buffer.h"
+#include "BufferSlab.h"
+#include "CurrentThread.h"
+#include "Timestamp.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const size_t kTotalBytes = 256 * 1024 * 1024;
+
+struct Result
+{
+    uint64_t syscalls = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+// 读端的一种实现：每次可读事件调用一次drain，返回这次读到的字节数，读的系统调用次数累加到syscalls
+class Reader
+{
+public:
+    virtual ~Reader() {}
+    virtual size_t drain(int fd, uint64_t *syscalls) = 0;
+    virtual size_t memory() const = 0;
+};
+
+// TcpConnection::handleRead的做法：一次事件一次readFd，数据取走后Buffer清空
+class BufferReader : public Reader
+{
+public:
+    size_t drain(int fd, uint64_t *syscalls) override
+    {
+        int savedErrno = 0;
+        ssize_t n = buf_.readFd(fd, &savedErrno);
+        ++*syscalls;
+        size_t got = n > 0 ? static_cast<size_t>(n) : 0;
+        buf_.retrieveAll();
+        return got;
+    }
+    size_t memory() const override { return sizeof buf_ + buf_.capacity(); }
+private:
+    Buffer buf_;
+};
+
+// 朴素实现：固定大小的缓冲区，read到EAGAIN为止（最后一次EAGAIN也是一次系统调用）
+class NaiveReader : public Reader
+{
+public:
+    explicit NaiveReader(size_t size) : buf_(size) {}
+    size_t drain(int fd, uint64_t *syscalls) override
+    {
+        size_t got = 0;
+        while (true)
+        {
+            ssize_t n = ::read(fd, buf_.data(), buf_.size());
+            ++*syscalls;
+            if (n <= 0)
+            {
+                break;
+            }
+            got += n;
+        }
+        return got;
+    }
+    size_t memory() const override { return sizeof buf_ + buf_.capacity(); }
+private:
+    std::vector<char> buf_;
+};
+
+// 写端每次写message字节（写不进去时先让读端读），读端每次“可读事件”drain一次
+Result run(Reader *reader, size_t message)
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+    ::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    ::fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    std::string data(message, 'x');
+    Result result;
+    Timestamp start = Timestamp::now();
+    size_t sent = 0;
+    while (sent < kTotalBytes)
+    {
+        size_t off = 0;
+        while (off < message)
+        {
+            ssize_t n = ::write(fds[1], data.data() + off, message - off);
+            if (n > 0)
+            {
+                off += n;
+            }
+            else
+            {
+                result.bytes += reader->drain(fds[0], &result.syscalls);
+            }
+        }
+        sent += message;
+        result.bytes += reader->drain(fds[0], &result.syscalls);
+    }
+    while (result.bytes < sent)
+    {
+        result.bytes += reader->drain(fds[0], &result.syscalls);
+    }
+    result.seconds = timeDifference(Timestamp::now(), start);
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return result;
+}
+
+void benchSyscalls()
+{
+    printf("%-10s %-22s %14s %10s %12s\n", "message", "reader", "bytes/syscall", "MB/s", "buffer mem");
+    const size_t messages[] = { 512, 4096, 16384, 65536, 262144 };
+    for (size_t message : messages)
+    {
+        BufferReader buffer;
+        NaiveReader naive4k(4096);
+        NaiveReader naive64k(65536);
+        struct { const char *name; Reader *reader; } readers[] = {
+            { "Buffer::readFd", &buffer },
+            { "read() loop, 4K", &naive4k },
+            { "read() loop, 64K", &naive64k },
+        };
+        for (auto &r : readers)
+        {
+            Result result = run(r.reader, message);
+            printf("%-10zu %-22s %14.0f %10.0f %12zu\n", message, r.name,
+                   static_cast<double>(result.bytes) / result.syscalls,
+                   result.bytes / result.seconds / (1024 * 1024),
+                   r.reader->memory());
+        }
+    }
+}
+
+// 一万个空闲连接的输入缓冲区占用的内存：从没收到数据、收过一条小消息、收过之后shrink(0)
+void benchIdleMemory()
+{
+    const int kConnections = 10000;
+    std::shared_ptr<BufferSlab> slab = std::make_shared<BufferSlab>(CurrentThread::tid());
+    std::vector<Buffer> buffers;
+    buffers.reserve(kConnections);
+    for (int i = 0; i < kConnections; ++i)
+    {
+        buffers.emplace_back(slab);
+    }
+    size_t never = 0;
+    for (const Buffer &b : buffers)
+    {
+        never += sizeof b + b.capacity();
+    }
+
+    for (Buffer &b : buffers)
+    {
+        b.append("GET / HTTP/1.1\r\n\r\n");
+        b.retrieveAll();
+    }
+    size_t afterMessage = 0;
+    for (const Buffer &b : buffers)
+    {
+        afterMessage += sizeof b + b.capacity();
+    }
+
+    for (Buffer &b : buffers)
+    {
+        b.shrink(0);
+    }
+    size_t afterShrink = 0;
+    for (const Buffer &b : buffers)
+    {
+        afterShrink += sizeof b + b.capacity();
+    }
+
+    printf("\nidle memory per connection (%d connections)\n", kConnections);
+    printf("  Buffer, never read            %8zu bytes\n", never / kConnections);
+    printf("  Buffer, after one message     %8zu bytes\n", afterMessage / kConnections);
+    printf("  Buffer, after shrink(0)       %8zu bytes\n", afterShrink / kConnections);
+    printf("  naive 64K read buffer         %8zu bytes\n", sizeof(std::vector<char>) + 65536);
+}
+
+} // namespace
+
+int main()
+{
+    benchSyscalls();
+    benchIdleMemory();
+    return 0;
+}
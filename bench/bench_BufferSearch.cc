@@ -0,0 +1,129 @@
+// Buffer::findCRLF的各个实现（标量、SSE2、AVX2）、findEOL（memchr）和std::search的对比：
+// 头部大小的输入逐行切分，以及大块输入里只在末尾有一个分隔符
+#include "BufferSearch.h"
+#include "Timestamp.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const char* searchCRLF(const char *begin, const char *end)
+{
+    static const char kCRLF[] = "\r\n";
+    const char *found = std::search(begin, end, kCRLF, kCRLF + 2);
+    return found == end ? nullptr : found;
+}
+
+const char* searchLF(const char *begin, const char *end, char c)
+{
+    const char *found = std::search(begin, end, &c, &c + 1);
+    return found == end ? nullptr : found;
+}
+
+struct Kernel
+{
+    const char *name;
+    buffersearch::FindCRLFFunc findCRLF;
+};
+
+// 把input按分隔符逐行切完算一次，返回每次的纳秒数；volatile的计数防止被优化掉
+template <typename Find>
+double timeSplitOnce(const std::string &input, size_t delimLen, Find find)
+{
+    const char *begin = input.data();
+    const char *end = begin + input.size();
+    size_t iterations = std::max<size_t>(1, 64 * 1024 * 1024 / input.size());
+    volatile size_t lines = 0;
+    Timestamp start = Timestamp::now();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        const char *p = begin;
+        const char *found;
+        while ((found = find(p, end)) != nullptr)
+        {
+            lines = lines + 1;
+            p = found + delimLen;
+        }
+    }
+    return timeDifference(Timestamp::now(), start) * 1e9 / iterations;
+}
+
+// 跑几遍取最快的一次，减少虚拟机上的抖动
+template <typename Find>
+double timeSplit(const std::string &input, size_t delimLen, Find find)
+{
+    double best = timeSplitOnce(input, delimLen, find);
+    for (int i = 1; i < 5; ++i)
+    {
+        best = std::min(best, timeSplitOnce(input, delimLen, find));
+    }
+    return best;
+}
+
+std::string httpHeader()
+{
+    return "GET /index.html?user=12345&session=abcdef0123456789 HTTP/1.1\r\n"
+           "Host: www.example.com\r\n"
+           "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+           "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+           "Accept-Language: en-US,en;q=0.5\r\n"
+           "Accept-Encoding: gzip, deflate, br\r\n"
+           "Connection: keep-alive\r\n"
+           "Cookie: id=a3fWa; theme=dark; lang=en; tracking=off; ab=1234567890\r\n"
+           "\r\n";
+}
+
+void bench(const char *title, const std::string &input, const std::vector<Kernel> &kernels)
+{
+    printf("%s (%zu bytes)\n", title, input.size());
+    printf("  %-22s %12s %12s\n", "impl", "ns", "GB/s");
+    auto report = [&input](const std::string &name, double ns) {
+        printf("  %-22s %12.1f %12.2f\n", name.c_str(), ns, input.size() / ns);
+    };
+    report("CRLF std::search", timeSplit(input, 2, searchCRLF));
+    for (const Kernel &k : kernels)
+    {
+        report(std::string("CRLF ") + k.name, timeSplit(input, 2, k.findCRLF));
+    }
+    report("LF std::search", timeSplit(input, 1, [](const char *b, const char *e) { return searchLF(b, e, '\n'); }));
+    report("LF memchr", timeSplit(input, 1, [](const char *b, const char *e) { return buffersearch::findByte(b, e, '\n'); }));
+    printf("\n");
+}
+
+} // namespace
+
+int main()
+{
+    std::vector<Kernel> kernels;
+    kernels.push_back(Kernel{ "scalar", buffersearch::findCRLFScalar });
+#ifdef MUDUO_X86_SIMD
+    if (buffersearch::hasSSE2())
+    {
+        kernels.push_back(Kernel{ "sse2", buffersearch::findCRLFSSE2 });
+    }
+    if (buffersearch::hasAVX2())
+    {
+        kernels.push_back(Kernel{ "avx2", buffersearch::findCRLFAVX2 });
+    }
+#endif
+
+    bench("HTTP request header, split into lines", httpHeader(), kernels);
+
+    // 行比较长、CR在行内出现的文本（SMTP DATA里常见）
+    std::string text;
+    while (text.size() < 16 * 1024)
+    {
+        text += std::string(70, 't') + "\r" + std::string(8, 'u') + "\r\n";
+    }
+    bench("16K text with stray CRs, 80-byte lines", text, kernels);
+
+    // 大块数据（例如redis的bulk字符串）在末尾才有分隔符
+    std::string bulk(1024 * 1024, 'x');
+    bulk += "\r\n";
+    bench("1M bulk, delimiter at the end", bulk, kernels);
+    return 0;
+}
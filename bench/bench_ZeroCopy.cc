@@ -0,0 +1,174 @@
+// TcpConnection::send(Buffer*)开启零拷贝（MSG_ZEROCOPY）和普通拷贝发送的对比：
+// 本机TCP连接，不同大小的消息，统计吞吐和发送线程（loop线程）消耗的CPU时间。
+// 注意loopback上内核投递时还是会拷贝一次（完成通知里带SO_EE_CODE_ZEROCOPY_COPIED），
+// 省不掉这次拷贝，还要多处理完成通知，这里的数字会低估真实网卡上的收益。
+// 库的日志打到stdout，结果打到stderr：bench_ZeroCopy > /dev/null
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Buffer.h"
+#include "BufferSlab.h"
+#include "Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+const size_t kTotalBytes = 512 * 1024 * 1024;
+const size_t kThreshold = 16 * 1024;
+
+struct Result
+{
+    bool supported = true;
+    double seconds = 0;
+    double cpuSeconds = 0;      // loop线程的用户态+内核态CPU时间
+    uint64_t received = 0;
+    uint64_t zeroCopySends = 0;
+    uint64_t zeroCopyCopied = 0;
+};
+
+double threadCpuSeconds()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// 建一对本机TCP连接，服务端在loop里每次写完一条消息（writeComplete）就发下一条，共kTotalBytes；
+// 客户端线程读到EOF为止
+Result run(size_t message, bool zeroCopy)
+{
+    int listenfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof addr;
+    if (::bind(listenfd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0
+        || ::listen(listenfd, 1) < 0
+        || ::getsockname(listenfd, reinterpret_cast<sockaddr*>(&addr), &len) < 0)
+    {
+        perror("listen");
+        exit(1);
+    }
+
+    int clientfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(clientfd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    sockaddr_in peer;
+    len = sizeof peer;
+    int connfd = ::accept4(listenfd, reinterpret_cast<sockaddr*>(&peer), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    ::close(listenfd);
+
+    Result result;
+    std::thread reader([clientfd, &result]() {
+        std::string buf(256 * 1024, '\0');
+        ssize_t n;
+        while ((n = ::read(clientfd, &buf[0], buf.size())) > 0)
+        {
+            result.received += n;
+        }
+        ::close(clientfd);
+    });
+
+    const std::string payload(message, 'x');
+    size_t sent = 0;
+    Timestamp start;
+    double cpuStart = 0;
+    {
+        EventLoop loop;
+        TcpConnectionPtr conn = std::make_shared<TcpConnection>(&loop, "bench", connfd,
+                                                                InetAddress(addr), InetAddress(peer));
+        if (zeroCopy)
+        {
+            conn->setZeroCopy(true, kThreshold);
+            result.supported = conn->zeroCopy();
+        }
+
+        // 应用层先把消息组装到Buffer里（两种方式都有这次拷贝），再交给send(Buffer*)
+        auto sendNext = [&payload, &sent](const TcpConnectionPtr &c) {
+            if (sent >= kTotalBytes)
+            {
+                return;
+            }
+            Buffer buf(c->getLoop()->bufferSlab());
+            buf.append(payload.data(), payload.size());
+            c->send(&buf);
+            sent += payload.size();
+            if (sent >= kTotalBytes)
+            {
+                c->shutdown();
+            }
+        };
+        conn->setConnectionCallback([&start, &cpuStart, sendNext](const TcpConnectionPtr &c) {
+            if (c->connected())
+            {
+                start = Timestamp::now();
+                cpuStart = threadCpuSeconds();
+                sendNext(c);
+            }
+        });
+        conn->setWriteCompleteCallback(sendNext);
+        conn->setCloseCallback([&loop, &conn, &result, &start, &cpuStart](const TcpConnectionPtr &c) {
+            result.seconds = timeDifference(Timestamp::now(), start);
+            result.cpuSeconds = threadCpuSeconds() - cpuStart;
+            result.zeroCopySends = c->zeroCopySends();
+            result.zeroCopyCopied = c->zeroCopyCopied();
+            loop.queueInLoop(std::bind(&TcpConnection::connectDestroyed, c));
+            loop.queueInLoop([&loop, &conn]() {
+                conn.reset();
+                loop.quit();
+            });
+        });
+        loop.runAfter(0, std::bind(&TcpConnection::connectEstablished, conn));
+        loop.loop();
+    }
+    reader.join();
+    return result;
+}
+
+} // namespace
+
+int main()
+{
+    fprintf(stderr, "%-10s %-10s %10s %12s %12s %10s %10s\n",
+            "message", "mode", "MB/s", "cpu ms", "cpu ns/KB", "zc sends", "zc copied");
+    const size_t messages[] = { 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 };
+    for (size_t message : messages)
+    {
+        for (int zeroCopy = 0; zeroCopy < 2; ++zeroCopy)
+        {
+            Result result = run(message, zeroCopy != 0);
+            if (!result.supported)
+            {
+                fprintf(stderr, "%-10zu %-10s SO_ZEROCOPY not supported\n", message, "zerocopy");
+                continue;
+            }
+            fprintf(stderr, "%-10zu %-10s %10.0f %12.1f %12.1f %10llu %10llu\n",
+                    message, zeroCopy ? "zerocopy" : "copy",
+                    result.received / result.seconds / (1024 * 1024),
+                    result.cpuSeconds * 1000,
+                    result.cpuSeconds * 1e9 / (result.received / 1024.0),
+                    static_cast<unsigned long long>(result.zeroCopySends),
+                    static_cast<unsigned long long>(result.zeroCopyCopied));
+        }
+    }
+    return 0;
+}
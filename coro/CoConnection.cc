@@ -0,0 +1,211 @@
+#include "CoConnection.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <string.h>
+
+namespace coro
+{
+
+const size_t CoConnection::kDefaultMaxBuffered;
+
+CoConnection::CoConnection(const TcpConnectionPtr &conn, size_t maxBuffered)
+    : conn_(conn)
+    , input_(conn->getLoop()->bufferSlab())    // 和连接的输入缓冲区用同一个slab，交换之后两边都还是slab的内存
+    , maxBuffered_(maxBuffered)
+    , closed_(false)
+    , readPaused_(false)
+    , reader_(nullptr)
+    , writer_(nullptr)
+{
+}
+
+std::shared_ptr<CoConnection> CoConnection::make(const TcpConnectionPtr &conn, size_t maxBuffered)
+{
+    if (!conn->getLoop()->isInLoopThread())
+    {
+        LOG_FATAL("%s:%s:%d CoConnection::make not in loop thread! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    std::shared_ptr<CoConnection> co(new CoConnection(conn, maxBuffered));
+    co->install();
+    return co;
+}
+
+void CoConnection::install()
+{
+    // 回调只持有weak_ptr，CoConnection的生命期由协程决定
+    std::weak_ptr<CoConnection> weak(shared_from_this());
+    conn_->setMessageCallback([weak](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+        if (std::shared_ptr<CoConnection> self = weak.lock())
+        {
+            self->onMessage(buf);
+        }
+    });
+    conn_->setWriteCompleteCallback([weak](const TcpConnectionPtr&) {
+        if (std::shared_ptr<CoConnection> self = weak.lock())
+        {
+            self->onWriteComplete();
+        }
+    });
+    // make一般是在ConnectionCallback里调用的，这时不能替换正在执行的connectionCallback_，
+    // 留到本轮循环末尾再换；如果这之前连接已经断开，就直接当作断开处理
+    conn_->getLoop()->runAtIterationEnd([weak]() {
+        std::shared_ptr<CoConnection> self = weak.lock();
+        if (!self)
+        {
+            return;
+        }
+        self->conn_->setConnectionCallback([weak](const TcpConnectionPtr &conn) {
+            std::shared_ptr<CoConnection> self = weak.lock();
+            if (self && !conn->connected())
+            {
+                self->onClose();
+            }
+        });
+        if (!self->conn_->connected())
+        {
+            self->onClose();
+        }
+    });
+}
+
+void CoConnection::ReadAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    if (conn_->reader_ != nullptr)
+    {
+        LOG_FATAL("%s:%s:%d CoConnection already has a pending read! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    handle_ = h;
+    conn_->reader_ = this;
+    conn_->updateReading();
+}
+
+void CoConnection::WriteAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    if (conn_->writer_ != nullptr)
+    {
+        LOG_FATAL("%s:%s:%d CoConnection already has a pending write! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    handle_ = h;
+    conn_->writer_ = this;
+    // 写完成回调总是经过queueInLoop，不会在send里面恢复协程
+    conn_->conn_->send(std::move(data_));
+}
+
+void CoConnection::onMessage(Buffer *buf)
+{
+    if (input_.readableBytes() == 0)
+    {
+        input_.swap(*buf);
+    }
+    else
+    {
+        input_.append(buf->peek(), buf->readableBytes());
+        buf->retrieveAll();
+    }
+    wakeReader();
+    updateReading();
+}
+
+void CoConnection::onWriteComplete()
+{
+    if (writer_ != nullptr)
+    {
+        WriteAwaiter *writer = writer_;
+        writer_ = nullptr;
+        writer->sent_ = true;
+        writer->handle_.resume();
+    }
+}
+
+void CoConnection::onClose()
+{
+    if (closed_)
+    {
+        return;
+    }
+    closed_ = true;
+    wakeReader();
+    if (writer_ != nullptr)
+    {
+        WriteAwaiter *writer = writer_;
+        writer_ = nullptr;
+        writer->handle_.resume();     // sent_为false
+    }
+}
+
+bool CoConnection::tryRead(ReadAwaiter *reader)
+{
+    const size_t readable = input_.readableBytes();
+    if (reader->delim_.empty())
+    {
+        if (readable >= reader->n_)
+        {
+            reader->result_ = input_.retrieveAsString(reader->n_);
+        }
+        else if (closed_)
+        {
+            reader->result_ = input_.retrieveAllAsString();
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else
+    {
+        const std::string &delim = reader->delim_;
+        // 上次查找的结尾可能是delim的前一部分，往回退delim.size()-1个字节
+        size_t from = reader->scanned_ >= delim.size() ? reader->scanned_ - delim.size() + 1 : 0;
+        const void *found = from < readable
+                          ? memmem(input_.peek() + from, readable - from, delim.data(), delim.size())
+                          : nullptr;
+        if (found != nullptr)
+        {
+            size_t len = static_cast<const char*>(found) - input_.peek() + delim.size();
+            reader->result_ = input_.retrieveAsString(len);
+        }
+        else if (closed_ || (maxBuffered_ > 0 && readable >= maxBuffered_))
+        {
+            reader->result_ = input_.retrieveAllAsString();
+        }
+        else
+        {
+            reader->scanned_ = readable;
+            return false;
+        }
+    }
+    updateReading();
+    return true;
+}
+
+void CoConnection::wakeReader()
+{
+    if (reader_ != nullptr && tryRead(reader_))
+    {
+        ReadAwaiter *reader = reader_;
+        reader_ = nullptr;
+        reader->handle_.resume();
+    }
+}
+
+void CoConnection::updateReading()
+{
+    if (closed_ || maxBuffered_ == 0)
+    {
+        return;
+    }
+    // 有读在等待时不暂停，否则read(n)的n比maxBuffered大时永远等不到
+    if (!readPaused_ && reader_ == nullptr && input_.readableBytes() >= maxBuffered_)
+    {
+        readPaused_ = true;
+        conn_->stopRead();
+    }
+    else if (readPaused_ && (reader_ != nullptr || input_.readableBytes() < maxBuffered_))
+    {
+        readPaused_ = false;
+        conn_->startRead();
+    }
+}
+
+} // namespace coro
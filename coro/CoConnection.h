@@ -0,0 +1,127 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+#include "TcpConnection.h"
+
+#include <coroutine>
+#include <memory>
+#include <string>
+
+class EventLoop;
+
+namespace coro
+{
+
+/**
+ * 用协程的方式读写TcpConnection：
+ *
+ *   server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+ *       if (conn->connected()) coro::spawn(session(coro::CoConnection::make(conn)));
+ *   });
+ *   coro::CoTask<> session(std::shared_ptr<coro::CoConnection> c) {
+ *       std::string line = co_await c->readUntil("\r\n");
+ *       co_await c->write("+OK\r\n");
+ *       ...
+ *   }
+ *
+ * make会接管conn的消息、写完成和连接回调（断开时服务器的ConnectionCallback不会再被调用），
+ * 收到的数据从连接的输入缓冲区转到CoConnection自己的缓冲区（缓冲区为空时直接交换，不拷贝；两边都从loop的BufferSlab分配）。
+ * 协程总是在连接的loop线程上、直接在这些回调里恢复，所以所有接口都只能在loop线程调用。
+ * CoConnection由协程持有，协程结束后回调自动失效。同一时刻最多一个读和一个写在等待
+ */
+class CoConnection : noncopyable, public std::enable_shared_from_this<CoConnection>
+{
+public:
+    class ReadAwaiter
+    {
+    public:
+        bool await_ready() { return conn_->tryRead(this); }
+        void await_suspend(std::coroutine_handle<> h);
+        std::string await_resume() { return std::move(result_); }
+    private:
+        friend class CoConnection;
+        ReadAwaiter(CoConnection *conn, size_t n) : conn_(conn), n_(n), scanned_(0) {}
+        ReadAwaiter(CoConnection *conn, std::string delim)
+            : conn_(conn), n_(0), delim_(std::move(delim)), scanned_(0) {}
+
+        CoConnection *conn_;
+        size_t n_;
+        std::string delim_;         // 非空时是readUntil
+        size_t scanned_;            // readUntil已经确认不含delim的字节数，不重复查找
+        std::coroutine_handle<> handle_;
+        std::string result_;
+    };
+
+    class WriteAwaiter
+    {
+    public:
+        bool await_ready() const { return conn_->closed_; }
+        void await_suspend(std::coroutine_handle<> h);
+        bool await_resume() const { return sent_; }
+    private:
+        friend class CoConnection;
+        WriteAwaiter(CoConnection *conn, std::string data)
+            : conn_(conn), data_(std::move(data)), sent_(false) {}
+
+        CoConnection *conn_;
+        std::string data_;
+        bool sent_;                 // 收到了写完成回调
+        std::coroutine_handle<> handle_;
+    };
+
+    // 必须在conn的loop线程上调用，一般在连接建立的ConnectionCallback里
+    static std::shared_ptr<CoConnection> make(const TcpConnectionPtr &conn,
+                                              size_t maxBuffered = kDefaultMaxBuffered);
+
+    const TcpConnectionPtr& connection() const { return conn_; }
+    EventLoop* loop() const { return conn_->getLoop(); }
+    // 连接已经断开，之后的读只返回缓冲区里剩下的数据
+    bool closed() const { return closed_; }
+    // 已经收到、还没被读走的字节数
+    size_t bufferedBytes() const { return input_.readableBytes(); }
+
+    /**
+     * 读n个字节。连接断开时返回剩下的数据（可能为空），长度不足n说明对端已经关闭
+     */
+    ReadAwaiter read(size_t n) { return ReadAwaiter(this, n); }
+    /**
+     * 读到delim为止（包括delim）。连接断开，或者缓冲的数据达到maxBuffered还没找到delim时，
+     * 返回已有的全部数据，不以delim结尾说明出错了
+     */
+    ReadAwaiter readUntil(std::string delim) { return ReadAwaiter(this, std::move(delim)); }
+    /**
+     * 发送data，等到发送缓冲区写空（WriteCompleteCallback）再恢复，返回false表示连接已经断开。
+     * 直接调用TcpConnection::send发送的数据也会触发写完成，不要混用
+     */
+    WriteAwaiter write(std::string data) { return WriteAwaiter(this, std::move(data)); }
+
+    void shutdown() { conn_->shutdown(); }
+    void forceClose() { conn_->forceClose(); }
+
+    // 没有读在等待时，缓冲超过这么多字节就暂停读（stopRead），被读走之后恢复。0表示不限制
+    static const size_t kDefaultMaxBuffered = 4 * 1024 * 1024;
+
+private:
+    CoConnection(const TcpConnectionPtr &conn, size_t maxBuffered);
+    void install();
+
+    void onMessage(Buffer *buf);
+    void onWriteComplete();
+    void onClose();
+
+    bool tryRead(ReadAwaiter *reader);
+    void wakeReader();
+    void updateReading();
+
+    TcpConnectionPtr conn_;
+    Buffer input_;
+    size_t maxBuffered_;
+    bool closed_;
+    bool readPaused_;           // 是我们因为缓冲太多而stopRead的
+    ReadAwaiter *reader_;
+    WriteAwaiter *writer_;
+};
+
+} // namespace coro
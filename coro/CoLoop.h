@@ -0,0 +1,64 @@
+#pragma once
+
+#include "EventLoop.h"
+
+#include <coroutine>
+
+namespace coro
+{
+
+/**
+ * EventLoop上的等待操作，不持有loop，可以随意按值传递。
+ * 协程总是在loop线程上恢复，恢复直接发生在定时器回调/pendingFunctors里，不经过其它线程。
+ * 等待期间loop被销毁的话协程不会再被恢复
+ */
+class CoLoop
+{
+public:
+    explicit CoLoop(EventLoop *loop) : loop_(loop) {}
+
+    EventLoop* loop() const { return loop_; }
+
+    struct SleepAwaiter
+    {
+        EventLoop *loop;
+        int ms;
+
+        bool await_ready() const noexcept { return ms <= 0 && loop->isInLoopThread(); }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            loop->runAfter(ms / 1000.0, [h]() { h.resume(); });
+        }
+        void await_resume() const noexcept {}
+    };
+
+    struct PostAwaiter
+    {
+        EventLoop *loop;
+        EventLoop::Priority priority;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            loop->queueInLoop([h]() { h.resume(); }, priority);
+        }
+        void await_resume() const noexcept {}
+    };
+
+    // 挂起ms毫秒后在loop线程上恢复（loop的定时器）
+    SleepAwaiter sleep(int ms) const { return SleepAwaiter{loop_, ms}; }
+
+    /**
+     * 把协程的剩余部分放进loop的pendingFunctors：在loop线程上调用是让出，
+     * 先处理这一轮的其它事件；在其它线程上调用是切换到loop线程上继续执行
+     */
+    PostAwaiter post(EventLoop::Priority priority = EventLoop::kLowPriority) const
+    {
+        return PostAwaiter{loop_, priority};
+    }
+
+private:
+    EventLoop *loop_;
+};
+
+} // namespace coro
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "Logger.h"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace coro
+{
+
+template <typename T>
+class CoTask;
+
+namespace detail
+{
+
+// CoTask<T>和CoTask<void>的promise的公共部分
+struct PromiseBase
+{
+    std::coroutine_handle<> continuation;   // co_await这个任务的协程，结束时直接切换回去
+    std::exception_ptr exception;
+    bool detached = false;                  // 被spawn出去的任务没有人等待，结束时自己销毁
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+        {
+            PromiseBase &promise = h.promise();
+            if (promise.continuation)
+            {
+                return promise.continuation;    // 对称转移，不会随着co_await的层数加深调用栈
+            }
+            if (promise.detached)
+            {
+                if (promise.exception)
+                {
+                    logException(promise.exception);
+                }
+                h.destroy();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+
+    static void logException(const std::exception_ptr &e)
+    {
+        try
+        {
+            std::rethrow_exception(e);
+        }
+        catch (const std::exception &ex)
+        {
+            LOG_ERROR("coro::spawn task exited with exception: %s \n", ex.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("coro::spawn task exited with unknown exception \n");
+        }
+    }
+};
+
+template <typename T>
+struct Promise : PromiseBase
+{
+    std::optional<T> value;
+
+    CoTask<T> get_return_object();
+    void return_value(T v) { value.emplace(std::move(v)); }
+
+    T result()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase
+{
+    CoTask<void> get_return_object();
+    void return_void() {}
+
+    void result()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * 协程的返回类型。创建后不会立即执行（惰性），两种启动方式：
+ * 在另一个协程里co_await它（结束后直接切回等待者，拿到返回值或者重新抛出异常），
+ * 或者交给coro::spawn在当前线程里立即开始执行、结束后自己销毁。
+ * 只能移动，析构时还没结束的任务会一起被销毁
+ */
+template <typename T = void>
+class CoTask
+{
+public:
+    using promise_type = detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit CoTask(Handle h) : handle_(h) {}
+    CoTask(CoTask &&rhs) noexcept : handle_(std::exchange(rhs.handle_, nullptr)) {}
+    CoTask& operator=(CoTask &&rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            if (handle_)
+            {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(rhs.handle_, nullptr);
+        }
+        return *this;
+    }
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+
+    ~CoTask()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    struct Awaiter
+    {
+        Handle handle;
+
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+        T await_resume() { return handle.promise().result(); }
+    };
+
+    Awaiter operator co_await() && noexcept { return Awaiter{handle_}; }
+
+    // 交出协程的所有权（spawn用）
+    Handle release() { return std::exchange(handle_, nullptr); }
+
+private:
+    Handle handle_;
+};
+
+namespace detail
+{
+
+template <typename T>
+CoTask<T> Promise<T>::get_return_object()
+{
+    return CoTask<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline CoTask<void> Promise<void>::get_return_object()
+{
+    return CoTask<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+/**
+ * 在当前线程里立即开始执行task，第一次挂起时返回。任务结束后自己销毁，
+ * 返回值被丢弃，没有捕获的异常只打一条错误日志
+ */
+template <typename T>
+void spawn(CoTask<T> task)
+{
+    auto h = task.release();
+    h.promise().detached = true;
+    h.resume();
+}
+
+} // namespace coro
@@ -0,0 +1,302 @@
+#include "Buffer.h"
+#include "BufferSlab.h"
+#include "CurrentThread.h"
+#include "BufferSearch.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string makeData(size_t len)
+{
+    std::string data(len, '\0');
+    for (size_t i = 0; i < len; ++i)
+    {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    return data;
+}
+
+std::string contents(const Buffer &buf)
+{
+    return std::string(buf.peek(), buf.readableBytes());
+}
+
+// 第一次写入之前不分配内存，空Buffer的peek()/beginWrite()也是合法指针
+void testLazyAllocation()
+{
+    Buffer buf;
+    assert(buf.capacity() == 0);
+    assert(buf.readableBytes() == 0);
+    assert(buf.writableBytes() == 0);
+    assert(buf.prependableBytes() == Buffer::kCheapPrepend);
+    assert(buf.peek() != nullptr);
+    assert(buf.peek() == buf.beginWrite());
+    assert(buf.retrieveAllAsString().empty());
+    assert(buf.findCRLF() == nullptr);
+    assert(buf.findEOL() == nullptr);
+
+    Buffer copy(buf);
+    assert(copy.capacity() == 0);
+
+    buf.append("x", 1);
+    assert(buf.capacity() == Buffer::kCheapPrepend + Buffer::kInitialSize);
+    assert(contents(buf) == "x");
+}
+
+// prepend用的是预留区域，不挪动数据；最多能写prependableBytes()字节
+void testPrepend()
+{
+    Buffer buf;
+    int32_t header = 42;
+    buf.prepend(&header, sizeof header);   // 空Buffer上prepend会先分配内存
+    assert(buf.capacity() > 0);
+    assert(buf.readableBytes() == sizeof header);
+    assert(buf.prependableBytes() == Buffer::kCheapPrepend - sizeof header);
+    buf.retrieveAll();
+
+    buf.append("body");
+    const char *body = buf.peek();
+    buf.prepend("HDR:", 4);
+    assert(buf.peek() + 4 == body);
+    assert(contents(buf) == "HDR:body");
+
+    // 预留区域刚好用完
+    buf.prepend("1234", 4);
+    assert(buf.prependableBytes() == 0);
+    assert(contents(buf) == "1234HDR:body");
+
+    // 读走数据之后prependable变大，又可以prepend更长的头
+    buf.retrieve(8);
+    assert(buf.prependableBytes() == 8);
+    buf.prepend("abcdefgh", 8);
+    assert(contents(buf) == "abcdefghbody");
+}
+
+// 空闲空间（读走的部分 + 可写部分）够用时把数据挪到前面，不够时按至少两倍重新分配
+void testMakeSpace()
+{
+    const std::string data = makeData(4000);
+    Buffer buf;
+    buf.append(data.data(), 1000);
+    const size_t capacity = buf.capacity();
+    assert(capacity == Buffer::kCheapPrepend + Buffer::kInitialSize);
+
+    buf.retrieve(900);
+    assert(buf.writableBytes() < 800);
+    buf.append(data.data() + 1000, 800);   // memmove：容量不变，数据挪到了kCheapPrepend
+    assert(buf.capacity() == capacity);
+    assert(buf.prependableBytes() == Buffer::kCheapPrepend);
+    assert(contents(buf) == data.substr(900, 900));
+
+    buf.append(data.data() + 1800, 2000);  // 重新分配
+    assert(buf.capacity() >= capacity * 2);
+    assert(buf.prependableBytes() == Buffer::kCheapPrepend);
+    assert(contents(buf) == data.substr(900, 2900));
+}
+
+// shrink只保留数据和reserve，没有数据时整块释放，之后还能继续用
+void testShrink()
+{
+    std::shared_ptr<BufferSlab> slab = std::make_shared<BufferSlab>(CurrentThread::tid());
+    const std::string data = makeData(20000);
+    {
+        Buffer buf(slab);
+        buf.append(data);
+        buf.retrieve(19900);
+        const size_t before = buf.capacity();
+        size_t released = buf.shrink(16);
+        assert(released > 0);
+        assert(buf.capacity() == before - released);
+        assert(buf.capacity() >= Buffer::kCheapPrepend + 100 + 16);
+        assert(buf.writableBytes() >= 16);
+        assert(contents(buf) == data.substr(19900));
+        assert(buf.slab() == slab);
+
+        assert(buf.shrink(buf.writableBytes()) == 0);    // 已经够紧了，不重新分配
+
+        buf.retrieveAll();
+        released = buf.shrink(0);
+        assert(released > 0);
+        assert(buf.capacity() == 0);
+        assert(slab->stats().bytesInUse == 0);
+
+        buf.append("again");
+        assert(contents(buf) == "again");
+    }
+    assert(slab->stats().bytesInUse == 0);
+}
+
+// readFd用栈上的64K做第二块iovec：Buffer很小时一次readv也能读进可写空间+64K
+void testReadFd()
+{
+    int fds[2];
+    assert(::pipe(fds) == 0);
+    ::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    const std::string data = makeData(60000);
+    assert(::write(fds[1], data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+
+    Buffer buf;
+    int savedErrno = 0;
+    ssize_t n = buf.readFd(fds[0], &savedErrno);
+    assert(n == static_cast<ssize_t>(data.size()));
+    assert(contents(buf) == data);
+
+    // 读不到数据时返回-1，空Buffer也不会因此分配内存
+    Buffer idle;
+    n = idle.readFd(fds[0], &savedErrno);
+    assert(n < 0 && savedErrno == EAGAIN);
+    assert(idle.capacity() == 0);
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+// 参照实现：std::search
+const char* referenceCRLF(const char *begin, const char *end)
+{
+    static const char kCRLF[] = "\r\n";
+    const char *found = std::search(begin, end, kCRLF, kCRLF + 2);
+    return found == end ? nullptr : found;
+}
+
+const char* referenceByte(const char *begin, const char *end, char c)
+{
+    const char *found = std::find(begin, end, c);
+    return found == end ? nullptr : found;
+}
+
+struct Kernel
+{
+    const char *name;
+    buffersearch::FindCRLFFunc findCRLF;
+};
+
+// 当前CPU上能运行的所有实现
+std::vector<Kernel> availableKernels()
+{
+    std::vector<Kernel> kernels;
+    kernels.push_back(Kernel{ "scalar", buffersearch::findCRLFScalar });
+#ifdef MUDUO_X86_SIMD
+    if (buffersearch::hasSSE2())
+    {
+        kernels.push_back(Kernel{ "sse2", buffersearch::findCRLFSSE2 });
+    }
+    if (buffersearch::hasAVX2())
+    {
+        kernels.push_back(Kernel{ "avx2", buffersearch::findCRLFAVX2 });
+    }
+#endif
+    return kernels;
+}
+
+// 在[begin, end)上所有实现都要和参照实现给出同一个结果
+void checkRange(const std::vector<Kernel> &kernels, const char *begin, const char *end)
+{
+    const char *crlf = referenceCRLF(begin, end);
+    const char *lf = referenceByte(begin, end, '\n');
+    if (buffersearch::findByte(begin, end, '\n') != lf)
+    {
+        fprintf(stderr, "findByte mismatch, len=%zu\n", static_cast<size_t>(end - begin));
+        abort();
+    }
+    for (const Kernel &k : kernels)
+    {
+        if (k.findCRLF(begin, end) != crlf)
+        {
+            fprintf(stderr, "%s mismatch, len=%zu\n", k.name, static_cast<size_t>(end - begin));
+            abort();
+        }
+    }
+}
+
+// 块边界上的情况：CR是16/32/64字节块的最后一个字节、CRLF跨块、长度小于16、CR在范围的最后一个字节（LF在范围外）
+void testSearchBoundaries()
+{
+    const std::vector<Kernel> kernels = availableKernels();
+    const size_t kMax = 200;     // 覆盖64字节主循环之后的32/16字节和标量尾部
+    std::vector<char> storage(kMax + 64, 'a');
+    for (size_t offset = 0; offset < 4; ++offset)      // 不同的对齐
+    {
+        char *base = storage.data() + offset;
+        for (size_t len = 0; len <= kMax; ++len)
+        {
+            std::fill(storage.begin(), storage.end(), 'a');
+            checkRange(kernels, base, base + len);
+            for (size_t pos = 0; pos < len; ++pos)
+            {
+                // 只有一个CR：后面跟LF（可能跨块，可能LF刚好在范围外）和后面不跟LF
+                std::fill(storage.begin(), storage.end(), 'a');
+                base[pos] = '\r';
+                checkRange(kernels, base, base + len);
+                base[pos + 1] = '\n';
+                checkRange(kernels, base, base + len);
+
+                // 前面有一个落单的CR，真正的CRLF在后面
+                if (pos + 3 < len)
+                {
+                    base[pos + 1] = 'b';
+                    base[pos + 2] = '\r';
+                    base[pos + 3] = '\n';
+                    checkRange(kernels, base, base + len);
+                }
+            }
+        }
+    }
+
+    // 通过Buffer的接口：start在中间、CRLF刚好在可读数据的末尾
+    Buffer buf;
+    buf.append(std::string(15, 'x') + "\r\n" + std::string(30, 'y') + "\r");
+    assert(buf.findCRLF() == buf.peek() + 15);
+    assert(buf.findCRLF(buf.peek() + 16) == nullptr);      // 最后的CR后面还没有LF
+    assert(buf.findEOL() == buf.peek() + 16);
+    assert(buf.findByte('y') == buf.peek() + 17);
+    buf.append("\n");
+    assert(buf.findCRLF(buf.peek() + 16) == buf.peek() + 47);
+}
+
+// 随机数据（CR、LF比较密集）上和参照实现对比
+void testSearchRandom()
+{
+    const std::vector<Kernel> kernels = availableKernels();
+    const char kAlphabet[] = "ab\r\n";
+    unsigned seed = 12345;
+    std::vector<char> data(4096);
+    for (int round = 0; round < 2000; ++round)
+    {
+        const size_t len = rand_r(&seed) % data.size();
+        const int density = 2 + rand_r(&seed) % 200;   // 平均每density个字节一个CR或LF
+        for (size_t i = 0; i < len; ++i)
+        {
+            int r = rand_r(&seed) % density;
+            data[i] = r < 2 ? kAlphabet[2 + r] : kAlphabet[r % 2];
+        }
+        const size_t start = len > 0 ? rand_r(&seed) % len : 0;
+        checkRange(kernels, data.data() + start, data.data() + len);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    testLazyAllocation();
+    testPrepend();
+    testMakeSpace();
+    testShrink();
+    testReadFd();
+    testSearchBoundaries();
+    testSearchRandom();
+    printf("test_Buffer passed\n");
+    return 0;
+}
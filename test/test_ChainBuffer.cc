@@ -0,0 +1,145 @@
+#include "ChainBuffer.h"
+#include "BufferSlab.h"
+#include "CurrentThread.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+
+namespace
+{
+
+std::string makeData(size_t len)
+{
+    std::string data(len, '\0');
+    for (size_t i = 0; i < len; ++i)
+    {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    return data;
+}
+
+std::string contents(const ChainBuffer &buf)
+{
+    std::string out(buf.readableBytes(), '\0');
+    size_t n = buf.copyOut(&out[0], out.size());
+    assert(n == out.size());
+    return out;
+}
+
+// slab分配出去还没有归还的块数
+size_t blocksInUse(const BufferSlab &slab)
+{
+    BufferSlab::Stats stats = slab.stats();
+    size_t blocks = 0;
+    for (int i = 0; i < BufferSlab::kNumClasses; ++i)
+    {
+        blocks += stats.classInUse[i];
+    }
+    return blocks;
+}
+
+// BlockRef的拷贝、移动、赋值都要正确维护引用计数
+void testBlockRef()
+{
+    BlockRef a = BlockRef::allocate(std::shared_ptr<BufferSlab>());
+    BufferBlock *block = a.get();
+    assert(block->refs.load() == 1);
+    assert(a.unique());
+    {
+        BlockRef b(a);
+        assert(b.get() == block);
+        assert(block->refs.load() == 2);
+        assert(!a.unique());
+
+        BlockRef c(std::move(b));
+        assert(b.get() == nullptr);
+        assert(block->refs.load() == 2);
+
+        BlockRef d;
+        d = c;
+        assert(block->refs.load() == 3);
+        d = BlockRef();
+        assert(block->refs.load() == 2);
+    }
+    assert(block->refs.load() == 1);
+    assert(a.unique());
+}
+
+// 块的最后一个引用释放时还回slab，共享的块要等所有ChainBuffer都释放
+void testSharedBlocksReturnToSlab()
+{
+    std::shared_ptr<BufferSlab> slab = std::make_shared<BufferSlab>(CurrentThread::tid());
+    const std::string data = makeData(BufferBlock::kBlockSize * 2 + 100);
+    {
+        ChainBuffer a(slab);
+        a.append(data);
+        assert(a.numBlocks() == 3);
+        assert(blocksInUse(*slab) == 3);
+
+        ChainBuffer b(slab);
+        b.append(a);                        // 零拷贝共享
+        assert(b.numBlocks() == 3);
+        ChainBuffer s = a.slice(100);
+        assert(s.numBlocks() == 1);
+        assert(contents(s) == data.substr(0, 100));
+
+        a.retrieveAll();
+        assert(blocksInUse(*slab) == 3);
+        assert(contents(b) == data);
+
+        b.retrieve(BufferBlock::kBlockSize + 10);   // 第一个块只剩s在引用
+        assert(b.numBlocks() == 2);
+        assert(contents(b) == data.substr(BufferBlock::kBlockSize + 10));
+        assert(blocksInUse(*slab) == 3);
+
+        s.retrieveAll();
+        assert(blocksInUse(*slab) == 2);
+    }
+    BufferSlab::Stats stats = slab->stats();
+    assert(stats.bytesInUse == 0);
+    assert(stats.allocations == stats.deallocations);
+}
+
+// 块被共享时不能在原地继续写，否则另一方看到的数据会被改掉
+void testNoWriteIntoSharedBlock()
+{
+    ChainBuffer a;
+    a.append("hello");
+    ChainBuffer b = a.slice(5);
+    assert(a.numBlocks() == 1 && b.numBlocks() == 1);
+
+    b.append(" world");
+    a.append(" there");
+    assert(contents(a) == "hello there");
+    assert(contents(b) == "hello world");
+    assert(a.numBlocks() == 2);
+    assert(b.numBlocks() == 2);
+
+    // 只有自己引用时直接写在尾块里
+    ChainBuffer c;
+    c.append("abc");
+    c.append("def");
+    assert(c.numSlices() == 1);
+    assert(contents(c) == "abcdef");
+}
+
+// 空链也能取出字符串
+void testEmptyRetrieve()
+{
+    ChainBuffer empty;
+    assert(empty.retrieveAllAsString().empty());
+    assert(empty.readableBytes() == 0);
+}
+
+} // namespace
+
+int main()
+{
+    testBlockRef();
+    testSharedBlocksReturnToSlab();
+    testNoWriteIntoSharedBlock();
+    testEmptyRetrieve();
+    printf("test_ChainBuffer passed\n");
+    return 0;
+}
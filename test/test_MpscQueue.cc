@@ -0,0 +1,97 @@
+#include "MpscQueue.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct Item
+{
+    MpscNode node;      // 必须放在开头
+    int producer;
+    int seq;
+};
+
+const int kProducers = 4;
+const int kItemsPerProducer = 100000;
+
+// 单线程：先进先出，空队列返回nullptr，取空之后还能继续用
+void testSingleThread()
+{
+    MpscQueue queue;
+    assert(queue.pop() == nullptr);
+
+    Item items[3];
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            items[i].seq = i;
+            queue.push(&items[i].node);
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            Item *item = reinterpret_cast<Item*>(queue.pop());
+            assert(item == &items[i]);
+        }
+        assert(queue.pop() == nullptr);
+    }
+}
+
+// 多个生产者并发push：一个不丢、一个不重复，同一个生产者的元素保持顺序
+void testMultiProducer()
+{
+    MpscQueue queue;
+    std::vector<Item> items(kProducers * kItemsPerProducer);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p)
+    {
+        producers.emplace_back([&queue, &items, p]() {
+            for (int i = 0; i < kItemsPerProducer; ++i)
+            {
+                Item &item = items[p * kItemsPerProducer + i];
+                item.producer = p;
+                item.seq = i;
+                queue.push(&item.node);
+            }
+        });
+    }
+
+    std::vector<int> next(kProducers, 0);
+    int total = 0;
+    while (total < kProducers * kItemsPerProducer)
+    {
+        MpscNode *node = queue.pop();
+        if (node == nullptr)
+        {
+            std::this_thread::yield();  // 队列空，或者有生产者push到一半
+            continue;
+        }
+        Item *item = reinterpret_cast<Item*>(node);
+        assert(item->seq == next[item->producer]);
+        ++next[item->producer];
+        ++total;
+    }
+    for (std::thread &t : producers)
+    {
+        t.join();
+    }
+    assert(queue.pop() == nullptr);
+    for (int p = 0; p < kProducers; ++p)
+    {
+        assert(next[p] == kItemsPerProducer);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    testSingleThread();
+    testMultiProducer();
+    printf("test_MpscQueue passed\n");
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+const size_t kFileSize = 8 * 1024 * 1024;  // 比socket缓冲区大，sendfile要等可写事件分几次发完
+
+using SendAll = std::function<void(const TcpConnectionPtr&)>;
+
+// 建一对本机TCP连接，服务端交给TcpConnection在loop里用sendAll发送，客户端线程读到EOF为止，返回收到的全部数据
+std::string runSession(bool edgeTriggered, const SendAll &sendAll)
+{
+    int listenfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;                  // 让内核挑端口
+    assert(::bind(listenfd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0);
+    assert(::listen(listenfd, 1) == 0);
+    socklen_t len = sizeof addr;
+    assert(::getsockname(listenfd, reinterpret_cast<sockaddr*>(&addr), &len) == 0);
+
+    int clientfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    assert(::connect(clientfd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0);
+    sockaddr_in peer;
+    len = sizeof peer;
+    int connfd = ::accept4(listenfd, reinterpret_cast<sockaddr*>(&peer), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    assert(connfd >= 0);
+    ::close(listenfd);
+
+    std::string received;
+    std::thread reader([clientfd, &received]() {
+        char buf[65536];
+        ssize_t n;
+        while ((n = ::read(clientfd, buf, sizeof buf)) > 0)
+        {
+            received.append(buf, n);
+        }
+        ::close(clientfd);
+    });
+
+    {
+        EventLoop loop;
+        TcpConnectionPtr conn = std::make_shared<TcpConnection>(&loop, "test", connfd,
+                                                                InetAddress(addr), InetAddress(peer));
+        if (edgeTriggered)
+        {
+            conn->setEdgeTriggered(true);
+        }
+        conn->setConnectionCallback([sendAll](const TcpConnectionPtr &c) {
+            if (c->connected())
+            {
+                sendAll(c);
+            }
+        });
+        conn->setWriteCompleteCallback([](const TcpConnectionPtr &c) { c->shutdown(); });
+        conn->setCloseCallback([&loop](const TcpConnectionPtr &c) {
+            loop.queueInLoop(std::bind(&TcpConnection::connectDestroyed, c));
+            loop.queueInLoop([&loop]() { loop.quit(); });
+        });
+        // 和TcpServer一样在loop里的事件回调中建立连接，send排进队列的写完成回调在同一轮执行
+        loop.runAfter(0, std::bind(&TcpConnection::connectEstablished, conn));
+        loop.loop();
+    }
+    reader.join();
+    return received;
+}
+
+// 写一个内容可以区分位置的临时文件，返回打开的fd，文件本身已经unlink
+int makeFile(std::string *content)
+{
+    char path[] = "/tmp/test_SendFileXXXXXX";
+    int fd = ::mkstemp(path);
+    assert(fd >= 0);
+    ::unlink(path);
+    content->resize(kFileSize);
+    for (size_t i = 0; i < kFileSize; ++i)
+    {
+        (*content)[i] = static_cast<char>('0' + i % 10 + (i / 1000) % 7);
+    }
+    assert(::write(fd, content->data(), content->size()) == static_cast<ssize_t>(content->size()));
+    return fd;
+}
+
+// send和sendFile交替调用，对端收到的顺序和调用顺序一致
+void testTrailerOrdering(bool edgeTriggered)
+{
+    std::string file;
+    int fd = makeFile(&file);
+    const std::string head(100000, 'H');
+
+    std::string received = runSession(edgeTriggered, [&](const TcpConnectionPtr &conn) {
+        conn->send(head);
+        conn->sendFile(fd, 10, kFileSize - 10);
+        conn->send(std::string("TAIL"));
+        conn->sendFile(fd, 0, 10);
+        conn->send(std::string("END"));
+    });
+    ::close(fd);
+
+    std::string expected = head + file.substr(10) + "TAIL" + file.substr(0, 10) + "END";
+    assert(received.size() == expected.size());
+    assert(received == expected);
+}
+
+// 文件比length短（提前EOF）时关闭连接，排在文件后面的数据不能发出去
+void testEarlyEofDropsTrailer(bool edgeTriggered)
+{
+    std::string file;
+    int fd = makeFile(&file);
+
+    std::string received = runSession(edgeTriggered, [&](const TcpConnectionPtr &conn) {
+        conn->send(std::string("HEAD"));
+        conn->sendFile(fd, 0, kFileSize + 1000);
+        conn->send(std::string("TRAILER"));
+    });
+    ::close(fd);
+
+    assert(received == "HEAD" + file);
+}
+
+} // namespace
+
+int main()
+{
+    testTrailerOrdering(false);
+    testTrailerOrdering(true);
+    testEarlyEofDropsTrailer(false);
+    testEarlyEofDropsTrailer(true);
+    printf("test_SendFile passed\n");
+    return 0;
+}
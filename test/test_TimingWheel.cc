@@ -0,0 +1,140 @@
+#include "TimingWheel.h"
+#include "EventLoop.h"
+#include "Timestamp.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+namespace
+{
+
+struct Entry
+{
+    TimingWheel::Node node;
+    double timeout;
+    Timestamp added;        // add时本轮poll返回的时间，超时从这里算起
+    Timestamp fired;
+    int fireCount = 0;
+};
+
+double seconds(Timestamp from, Timestamp to)
+{
+    return static_cast<double>(to.microSecondsSinceEpoch() - from.microSecondsSinceEpoch())
+           / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 在一个tick中间添加节点：到期不能早于timeout，最多晚一个tick（再留一点调度的余量）
+void testExpiryBounds()
+{
+    EventLoop loop;
+    TimingWheel *wheel = loop.timingWheel();
+    const double tick = wheel->tickSeconds();
+    const double kSlack = 0.05;
+
+    std::vector<Entry> entries(4);
+    entries[0].timeout = tick * 0.5;
+    entries[1].timeout = tick;
+    entries[2].timeout = tick * 1.5;
+    entries[3].timeout = tick * 3;
+    int pending = static_cast<int>(entries.size());
+
+    // 先让时间轮的定时器转起来，再在tick的中间挂节点，这正是向下取整会提前到期的情况
+    TimingWheel::Node starter;
+    wheel->add(&starter, tick * 10, []() {});
+    loop.runAfter(tick * 1.5, [&]() {
+        wheel->remove(&starter);
+        for (Entry &e : entries)
+        {
+            Entry *entry = &e;
+            entry->added = loop.pollReturnTime();
+            wheel->add(&entry->node, entry->timeout, [&loop, &pending, entry]() {
+                entry->fired = Timestamp::now();
+                ++entry->fireCount;
+                if (--pending == 0)
+                {
+                    loop.quit();
+                }
+            });
+        }
+    });
+    loop.runAfter(tick * 20, [&loop]() { loop.quit(); });     // 防止卡住
+    loop.loop();
+
+    assert(pending == 0);
+    for (const Entry &e : entries)
+    {
+        double elapsed = seconds(e.added, e.fired);
+        double ticks = ::ceil(e.timeout / tick);
+        assert(e.fireCount == 1);
+        assert(elapsed >= e.timeout);
+        assert(elapsed <= ticks * tick + tick + kSlack);
+    }
+    assert(wheel->size() == 0);
+}
+
+// 同一批到期的节点，前面的回调remove了后面的节点，后面的节点不会再被回调
+void testRemoveWithinBatch()
+{
+    EventLoop loop;
+    TimingWheel *wheel = loop.timingWheel();
+    const double tick = wheel->tickSeconds();
+
+    TimingWheel::Node a;
+    TimingWheel::Node b;
+    int firedA = 0;
+    int firedB = 0;
+    loop.runAfter(0.01, [&]() {
+        wheel->add(&a, tick, [&]() {
+            ++firedA;
+            wheel->remove(&b);
+        });
+        wheel->add(&b, tick, [&]() {
+            ++firedB;
+            wheel->remove(&a);
+        });
+    });
+    loop.runAfter(tick * 5, [&loop]() { loop.quit(); });
+    loop.loop();
+
+    assert(firedA + firedB == 1);
+    assert(!a.linked() && !b.linked());
+    assert(wheel->size() == 0);
+    assert(wheel->expiredCount() == 1);
+}
+
+// refresh从现在重新计时，在原来的到期时间之前不断refresh就不会到期
+void testRefresh()
+{
+    EventLoop loop;
+    TimingWheel *wheel = loop.timingWheel();
+    const double tick = wheel->tickSeconds();
+
+    TimingWheel::Node node;
+    int fired = 0;
+    loop.runAfter(0.01, [&]() {
+        wheel->add(&node, tick * 3, [&fired]() { ++fired; });
+    });
+    TimerId refresher = loop.runEvery(tick, [&]() { wheel->refresh(&node); });
+    loop.runAfter(tick * 8, [&]() {
+        assert(fired == 0);
+        loop.cancel(refresher);
+    });
+    loop.runAfter(tick * 14, [&loop]() { loop.quit(); });
+    loop.loop();
+
+    assert(fired == 1);
+    assert(wheel->size() == 0);
+}
+
+} // namespace
+
+int main()
+{
+    testExpiryBounds();
+    testRemoveWithinBatch();
+    testRefresh();
+    printf("test_TimingWheel passed\n");
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Buffer.h"
+#include "BufferSlab.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+const size_t kPayload = 60000;      // 从slab的64K size class分配
+const size_t kThreshold = 16 * 1024;
+
+using SendAll = std::function<void(const TcpConnectionPtr&)>;
+
+// slab分配出去还没有归还的块数
+size_t blocksInUse(const BufferSlab &slab)
+{
+    BufferSlab::Stats stats = slab.stats();
+    size_t blocks = 0;
+    for (int i = 0; i < BufferSlab::kNumClasses; ++i)
+    {
+        blocks += stats.classInUse[i];
+    }
+    return blocks;
+}
+
+std::string makePayload()
+{
+    std::string data(kPayload, '\0');
+    for (size_t i = 0; i < kPayload; ++i)
+    {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    return data;
+}
+
+/**
+ * 建一对本机TCP连接，服务端开启零拷贝，在loop里用sendAll发送；客户端线程读到EOF为止。
+ * 连接销毁之后继续跑loop，直到slab上的块全部归还（零拷贝的数据等完成通知之后才释放）。
+ * received返回客户端收到的数据，inUseAtDestroy返回连接析构之后slab上还没归还的块数，
+ * 内核不支持零拷贝时返回false
+ */
+bool runSession(const SendAll &sendAll, std::string *received, size_t *inUseAtDestroy)
+{
+    int listenfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    assert(::bind(listenfd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0);
+    assert(::listen(listenfd, 1) == 0);
+    socklen_t len = sizeof addr;
+    assert(::getsockname(listenfd, reinterpret_cast<sockaddr*>(&addr), &len) == 0);
+
+    int clientfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    // 客户端的接收窗口很小、开始时又不读，数据留在服务端的发送队列里，完成通知要等客户端读了才到
+    int rcvbuf = 4096;
+    ::setsockopt(clientfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    assert(::connect(clientfd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0);
+    sockaddr_in peer;
+    len = sizeof peer;
+    int connfd = ::accept4(listenfd, reinterpret_cast<sockaddr*>(&peer), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    assert(connfd >= 0);
+    ::close(listenfd);
+
+    std::thread reader([clientfd, received]() {
+        char buf[65536];
+        ssize_t n;
+        ::usleep(200 * 1000);
+        while ((n = ::read(clientfd, buf, sizeof buf)) > 0)
+        {
+            received->append(buf, n);
+        }
+        ::close(clientfd);
+    });
+
+    bool supported = true;
+    {
+        EventLoop loop;
+        TcpConnectionPtr conn = std::make_shared<TcpConnection>(&loop, "test", connfd,
+                                                                InetAddress(addr), InetAddress(peer));
+        conn->setZeroCopy(true, kThreshold);
+        supported = conn->zeroCopy();
+        conn->setConnectionCallback([sendAll](const TcpConnectionPtr &c) {
+            if (c->connected())
+            {
+                sendAll(c);
+            }
+            else
+            {
+                assert(c->zeroCopySends() > 0);
+            }
+        });
+        // 和TcpServer一样，关闭之后connectDestroyed，再放掉最后一个引用，连接在loop里析构
+        conn->setCloseCallback([&loop, &conn, inUseAtDestroy](const TcpConnectionPtr &c) {
+            loop.queueInLoop(std::bind(&TcpConnection::connectDestroyed, c));
+            loop.queueInLoop([&loop, &conn, inUseAtDestroy]() {
+                conn.reset();
+                *inUseAtDestroy = blocksInUse(*loop.bufferSlab());
+            });
+        });
+        loop.runAfter(0, std::bind(&TcpConnection::connectEstablished, conn));
+
+        const std::shared_ptr<BufferSlab> &slab = loop.bufferSlab();
+        loop.runEvery(0.01, [&loop, &slab]() {
+            if (blocksInUse(*slab) == 0)
+            {
+                loop.quit();
+            }
+        });
+        loop.runAfter(5, [&loop]() { loop.quit(); });  // 防止卡住
+        loop.loop();
+        assert(!conn);
+        assert(blocksInUse(*slab) == 0);
+    }
+    reader.join();
+    return supported;
+}
+
+// send(Buffer*)把数据换给零拷贝的holder之后，调用者的Buffer还是用原来的slab
+void testSendBufferKeepsSlab()
+{
+    std::string received;
+    size_t inUseAtDestroy = 0;
+    const std::string payload = makePayload();
+    bool supported = runSession([&payload](const TcpConnectionPtr &conn) {
+        Buffer buf(conn->getLoop()->bufferSlab());
+        buf.append(payload.data(), payload.size());
+        conn->send(&buf);
+        assert(buf.readableBytes() == 0);
+        assert(buf.slab() == conn->getLoop()->bufferSlab());
+        conn->shutdown();       // 要等完成通知到了才关闭写端
+    }, &received, &inUseAtDestroy);
+    if (!supported)
+    {
+        printf("SO_ZEROCOPY not supported, skipped\n");
+        return;
+    }
+    assert(received == payload);
+}
+
+// 数据还没收到完成通知就强制关闭：数据要等通知到了才释放（loop上的块最后全部归还），对端照样收到完整的数据
+void testForceCloseWithPendingCompletions()
+{
+    std::string received;
+    size_t inUseAtDestroy = 0;
+    const std::string payload = makePayload();
+    bool supported = runSession([&payload](const TcpConnectionPtr &conn) {
+        Buffer buf(conn->getLoop()->bufferSlab());
+        buf.append(payload.data(), payload.size());
+        conn->send(&buf);
+        conn->forceClose();
+    }, &received, &inUseAtDestroy);
+    if (!supported)
+    {
+        return;
+    }
+    assert(inUseAtDestroy >= 1);    // 客户端还没读，内核还在引用holder，不能随连接释放
+    assert(payload.compare(0, received.size(), received) == 0);
+}
+
+} // namespace
+
+int main()
+{
+    testSendBufferKeepsSlab();
+    testForceCloseWithPendingCompletions();
+    printf("test_ZeroCopy passed\n");
+    return 0;
+}